@@ -0,0 +1,140 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+#include <charconv>
+
+#include <mpi.h>
+
+#include "input_parser.hpp"
+
+// job farm over many inputs in one launch (--batch): the world is split into groups of consecutive ranks, every group
+// runs one scenario at a time on its own communicator, and a group that is done takes the next scenario off a counter
+// on world rank 0 (MPI_Fetch_and_op), so short scenarios do not hold up the long ones
+// scenarios are handed out from the most expensive down, and the groups are sized for the first of them: the ranks
+// are split in proportion to the estimated cost of the scenarios the groups start with, one group per rank at most
+namespace batch {
+
+// the input files of a list, one per line, blank lines and lines starting with # skipped
+inline std::vector<std::string> read_list(const std::string &path) {
+    std::vector<std::string> out;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if (!line.empty() && line[0] != '#') out.push_back(line);
+    }
+    return out;
+}
+
+// expected work of a scenario: ticks * (platforms on the lines + trains), read off the head and the tail of the file
+// without touching the matrix, which is most of it. 0 if the file can't be read
+inline double estimate_cost(const std::string &path) {
+    MappedFile file(path.c_str());
+    if (!file.is_open()) return 0;
+    InputScanner head(file.begin(), file.end());
+    head.number<size_t>();
+    size_t V = head.number<size_t>();
+
+    // from the end: the ticks to print, the trains per line and the ticks, then the V lines
+    const char *begin = file.begin(), *p = file.end();
+    auto previous_number = [&]() {
+        while (p > begin && InputScanner::is_space(p[-1])) p--;
+        const char *last = p;
+        while (p > begin && !InputScanner::is_space(p[-1])) p--;
+        long long value = 0;
+        std::from_chars(p, last, value);
+        return value;
+    };
+    previous_number();
+    double trains = 0;
+    for (size_t i = 0; i < V; i++) trains += previous_number();
+    double ticks = previous_number();
+
+    // a line of k stations has a platform each way between neighbours
+    double platforms = 0;
+    for (size_t i = 0; i < V; i++) {
+        while (p > begin && InputScanner::is_space(p[-1])) p--;
+        int stations = 0;
+        while (p > begin && p[-1] != '\n') {
+            if (!InputScanner::is_space(p[-1]) && (p - 1 == begin || InputScanner::is_space(p[-2]))) stations++;
+            p--;
+        }
+        platforms += 2 * std::max(stations - 1, 0);
+    }
+    return ticks * (platforms + trains);
+}
+
+// ranks of each group, for scenarios in decreasing cost: as many groups as ranks or scenarios, whichever is fewer,
+// sized by largest remainder on the costs of the scenarios they start with, every group at least one rank
+inline std::vector<int> group_sizes(const std::vector<double> &sorted_costs, int total_processes) {
+    int groups = std::min<int>(total_processes, sorted_costs.size());
+    std::vector<int> sizes(groups, 1);
+    if (groups == 0) return sizes;
+
+    double sum = 0;
+    for (int g = 0; g < groups; g++) sum += sorted_costs[g];
+    int spare = total_processes - groups;
+    std::vector<double> share(groups);
+    for (int g = 0; g < groups; g++) {
+        share[g] = sum > 0 ? spare * sorted_costs[g] / sum : (double) spare / groups;
+        sizes[g] += (int) share[g];
+        spare -= (int) share[g];
+    }
+    std::vector<int> order(groups);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return share[a] - (int) share[a] > share[b] - (int) share[b]; });
+    for (int i = 0; spare > 0; i = (i + 1) % groups, spare--) sizes[order[i]]++;
+    return sizes;
+}
+
+// the counter of the next scenario to hand out, on world rank 0
+class Dispenser {
+  private:
+    MPI_Win window = MPI_WIN_NULL;
+    int *counter = nullptr;
+
+  public:
+    // collective over comm, the first `first` scenarios are already taken
+    Dispenser(int first, MPI_Comm comm) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, comm, &counter, &window);
+        if (rank == 0) {
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, window);
+            *counter = first;
+            MPI_Win_unlock(0, window);
+        }
+        MPI_Barrier(comm);
+    }
+
+    ~Dispenser() {
+        MPI_Win_free(&window);
+    }
+
+    Dispenser(const Dispenser &) = delete;
+    Dispenser &operator=(const Dispenser &) = delete;
+
+    int next() {
+        int one = 1, taken;
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, window);
+        MPI_Fetch_and_op(&one, &taken, MPI_INT, 0, 0, MPI_SUM, window);
+        MPI_Win_unlock(0, window);
+        return taken;
+    }
+};
+
+// where the printed states of a scenario go: <dir>/<input file name without extension>.out
+inline std::string output_path(const std::string &dir, std::string_view input) {
+    size_t slash = input.find_last_of('/');
+    if (slash != std::string_view::npos) input.remove_prefix(slash + 1);
+    size_t dot = input.find_last_of('.');
+    if (dot != std::string_view::npos && dot > 0) input = input.substr(0, dot);
+    return dir + "/" + std::string(input) + ".out";
+}
+
+}  // namespace batch
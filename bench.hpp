@@ -0,0 +1,184 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>
+
+// small microbenchmark harness for the bench_* binaries, in the style of Google Benchmark
+// a benchmark is a function that runs its body state.iterations times. The harness keeps doubling (or scaling) the
+// iterations until a run takes at least the minimum time, and reports the time per iteration of that last run. The
+// results are written as Google Benchmark JSON, so they can be compared across commits with its tools
+// flags: --benchmark_filter=SUBSTRING, --benchmark_min_time=SECONDS, --benchmark_out=FILE (JSON, default stdout)
+
+class BenchState {
+  private:
+    using clock = std::chrono::steady_clock;
+    clock::time_point start;
+    double paused_ns = 0;
+    clock::time_point pause_start;
+
+    static double cpu_now_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+    }
+
+    double cpu_start = 0, cpu_paused_ns = 0, cpu_pause_start = 0;
+
+  public:
+    long long iterations;
+    long long items_per_iteration = 0;  // for items_per_second, 0 leaves it out
+    long long bytes_per_iteration = 0;  // for bytes_per_second, 0 leaves it out
+
+    explicit BenchState(long long iterations) : iterations(iterations) {}
+
+    void begin() {
+        start = clock::now();
+        cpu_start = cpu_now_ns();
+    }
+
+    // setup inside the timed loop goes between pause and resume
+    void pause() {
+        pause_start = clock::now();
+        cpu_pause_start = cpu_now_ns();
+    }
+
+    void resume() {
+        paused_ns += std::chrono::duration<double, std::nano>(clock::now() - pause_start).count();
+        cpu_paused_ns += cpu_now_ns() - cpu_pause_start;
+    }
+
+    double real_ns() const {
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() - paused_ns;
+    }
+
+    double cpu_ns() const {
+        return cpu_now_ns() - cpu_start - cpu_paused_ns;
+    }
+};
+
+// keeps the compiler from dropping a computation whose result is otherwise unused
+template <typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class BenchSuite {
+  private:
+    struct Entry {
+        std::string name;
+        std::function<void(BenchState &)> fn;
+    };
+
+    struct Result {
+        std::string name;
+        long long iterations;
+        double real_ns, cpu_ns;  // per iteration
+        long long items, bytes;
+    };
+
+    std::vector<Entry> entries;
+
+    static std::string json_escape(const std::string &s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    static Result run_one(const Entry &entry, double min_time) {
+        long long iterations = 1;
+        while (true) {
+            BenchState state(iterations);
+            state.begin();
+            entry.fn(state);
+            double real = state.real_ns(), cpu = state.cpu_ns();
+
+            if (real >= min_time * 1e9 || iterations >= (1LL << 40)) {
+                return {entry.name, iterations, real / iterations, cpu / iterations, state.items_per_iteration,
+                        state.bytes_per_iteration};
+            }
+            // aim a bit past the minimum time, but grow at most 10x per round
+            double scale = real > 0 ? min_time * 1e9 * 1.4 / real : 10;
+            iterations = std::max(iterations + 1, (long long)(iterations * std::min(scale, 10.0)));
+        }
+    }
+
+  public:
+    void add(std::string name, std::function<void(BenchState &)> fn) {
+        entries.push_back({std::move(name), std::move(fn)});
+    }
+
+    int run(int argc, char *argv[]) {
+        std::string filter, out_path;
+        double min_time = 0.5;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.rfind("--benchmark_filter=", 0) == 0) {
+                filter = arg.substr(19);
+            } else if (arg.rfind("--benchmark_min_time=", 0) == 0) {
+                min_time = std::atof(arg.substr(21).c_str());
+            } else if (arg.rfind("--benchmark_out=", 0) == 0) {
+                out_path = arg.substr(16);
+            } else {
+                std::cerr << "usage: " << argv[0]
+                          << " [--benchmark_filter=SUBSTRING] [--benchmark_min_time=SECONDS] [--benchmark_out=FILE]\n";
+                return 1;
+            }
+        }
+
+        std::vector<Result> results;
+        std::fprintf(stderr, "%-48s %14s %14s %12s\n", "benchmark", "time/iter", "cpu/iter", "iterations");
+        for (const Entry &entry : entries) {
+            if (entry.name.find(filter) == std::string::npos) continue;
+            Result r = run_one(entry, min_time);
+            std::fprintf(stderr, "%-48s %11.1f ns %11.1f ns %12lld\n", r.name.c_str(), r.real_ns, r.cpu_ns,
+                         r.iterations);
+            results.push_back(r);
+        }
+
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        char date[64];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+        std::ostringstream json;
+        json << "{\n  \"context\": {\n"
+             << "    \"date\": \"" << date << "\",\n"
+             << "    \"host_name\": \"" << json_escape(host) << "\",\n"
+             << "    \"executable\": \"" << json_escape(argv[0]) << "\",\n"
+             << "    \"num_cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << "\n"
+             << "  },\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result &r = results[i];
+            json << (i ? ",\n" : "\n") << "    {\n"
+                 << "      \"name\": \"" << json_escape(r.name) << "\",\n"
+                 << "      \"run_type\": \"iteration\",\n"
+                 << "      \"iterations\": " << r.iterations << ",\n"
+                 << "      \"real_time\": " << r.real_ns << ",\n"
+                 << "      \"cpu_time\": " << r.cpu_ns << ",\n";
+            if (r.items) json << "      \"items_per_second\": " << r.items * 1e9 / r.real_ns << ",\n";
+            if (r.bytes) json << "      \"bytes_per_second\": " << r.bytes * 1e9 / r.real_ns << ",\n";
+            json << "      \"time_unit\": \"ns\"\n    }";
+        }
+        json << "\n  ]\n}\n";
+
+        if (out_path.empty()) {
+            std::cout << json.str();
+        } else {
+            std::ofstream(out_path) << json.str();
+        }
+        return 0;
+    }
+};
@@ -0,0 +1,69 @@
+#include "input_parser.hpp"
+#include "topology.hpp"
+#include "bench.hpp"
+#include <bits/stdc++.h>
+using namespace std;
+
+// input parser benchmarks on generated inputs: scanning the adjacency matrix of S stations into the CSR topology (the
+// part of the input that grows as S^2, which each rank of load_input does for its block of rows), from a mapped file,
+// with the same parse_matrix_rows the loader and trains_seq use. The generated inputs are removed afterwards
+
+// writes an input with num_stations stations on a ring plus random chords, in the format of the testcases
+string generate_input(int num_stations) {
+    mt19937 rng(3);
+    string path = "/tmp/bench_parser_" + to_string(num_stations) + ".in";
+    ofstream out(path);
+    out << num_stations << "\n3\n";
+    for (int i = 0; i < num_stations; i++) out << "s" << i << (i + 1 < num_stations ? " " : "\n");
+    for (int i = 0; i < num_stations; i++) out << 1 + rng() % 10 << (i + 1 < num_stations ? " " : "\n");
+
+    string row;
+    for (int src = 0; src < num_stations; src++) {
+        row.clear();
+        for (int dst = 0; dst < num_stations; dst++) {
+            bool link = dst == (src + 1) % num_stations || src == (dst + 1) % num_stations || rng() % 200 == 0;
+            row += to_string(link && src != dst ? 1 + rng() % 20 : 0);
+            row += dst + 1 < num_stations ? ' ' : '\n';
+        }
+        out << row;
+    }
+    for (int line = 0; line < 3; line++) out << "s0 s1 s2\n";
+    out << "100\n1 1 1\n10\n";
+    return path;
+}
+
+int main(int argc, char *argv[]) {
+    BenchSuite suite;
+
+    vector<string> paths;
+    for (int num_stations : {256, 2048}) {
+        string path = generate_input(num_stations);
+        paths.push_back(path);
+        size_t file_size = filesystem::file_size(path);
+
+        suite.add("parse_matrix/stations:" + to_string(num_stations), [path, num_stations, file_size](BenchState &state) {
+            for (long long i = 0; i < state.iterations; i++) {
+                MappedFile file(path.c_str());
+                InputScanner in(file.begin(), file.end());
+                size_t S = in.number<size_t>();
+                in.number<size_t>();
+                for (size_t s = 0; s < S; s++) in.word();
+                for (size_t s = 0; s < S; s++) in.number<size_t>();
+                in.line();
+
+                Topology topology(S);
+                parse_matrix_rows(in.position(), file.end(), 0, S, [&](long long src, size_t dst, int travel_time) {
+                    topology.add_link(src, dst, travel_time);
+                });
+                topology.finish();
+                do_not_optimize(topology.num_links());
+            }
+            state.bytes_per_iteration = file_size;
+            state.items_per_iteration = (long long)num_stations * num_stations;
+        });
+    }
+
+    int status = suite.run(argc, argv);
+    for (const string &path : paths) filesystem::remove(path);
+    return status;
+}
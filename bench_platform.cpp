@@ -0,0 +1,108 @@
+#include "structs.hpp"
+#include "platform_clock.hpp"
+#include "bench.hpp"
+#include <bits/stdc++.h>
+using namespace std;
+
+// Platform benchmarks: the holding area heap with large queues, and the moves between holding area, platform and link
+// the reseed a train entry leaves pending is finished with a dummy seed, so the timings are of the platform alone
+// (bench_reseed has the reseed)
+
+void skip_reseed(Platform &platform) {
+    if (platform.pltg.try_claim()) platform.pltg.complete_reseed(platform.pltg.pending_seed());
+}
+
+// a platform with queued trains waiting in its holding area, all arrived at different ticks
+Platform platform_with_queue(int queued) {
+    Platform platform(0, 1, 5, 3);
+    for (int i = 0; i < queued; i++) platform.send_in({'g', i}, i);
+    return platform;
+}
+
+int main(int argc, char *argv[]) {
+    BenchSuite suite;
+
+    for (int queued : {16, 1024, 65536, 1 << 20}) {
+        string size = to_string(queued);
+
+        // one train into the heap and the earliest one out of it, so the queue stays the same size
+        suite.add("Platform::send_in+push_train_to_platform/queue:" + size, [queued](BenchState &state) {
+            Platform platform = platform_with_queue(queued);
+            for (long long i = 0; i < state.iterations; i++) {
+                platform.send_in({'g', (int)(queued + i)}, queued + i);
+                platform.push_train_to_platform(i);
+                skip_reseed(platform);
+                platform.train.reset();
+            }
+            do_not_optimize(platform.pq.size());
+            state.items_per_iteration = 1;
+        });
+
+        // a whole batch of arrivals of one tick, as sendout_sendin_trains hands over trains
+        suite.add("Platform::send_in(vector)/queue:" + size, [queued](BenchState &state) {
+            vector<Train> trains(64);
+            for (int i = 0; i < 64; i++) trains[i] = {'b', queued + i};
+            Platform full = platform_with_queue(queued), platform = full;
+            for (long long i = 0; i < state.iterations; i++) {
+                // back to the full queue, into the same buffer
+                state.pause();
+                platform.pq.assign(full.pq.begin(), full.pq.end());
+                state.resume();
+                platform.send_in(trains, queued);
+                do_not_optimize(platform.pq.front());
+            }
+            state.items_per_iteration = 64;
+        });
+    }
+
+    // the train leaves the link and the unloaded train moves from the platform into the link
+    suite.add("Platform::send_out", [](BenchState &state) {
+        Platform platform(0, 1, 5, 3);
+        int sink = 0;
+        for (long long i = 0; i < state.iterations; i++) {
+            int tick = 10 * i;
+            platform.train = Train{'y', (int)i};
+            platform.enter_time = tick - 10;
+            platform.unloading_time = 5;
+            sink += platform.send_out(tick).id;
+        }
+        do_not_optimize(sink);
+        state.items_per_iteration = 1;
+    });
+
+    // the readiness sweep of one tick over the platforms of a rank, 1 in 64 of them due
+    for (int num_platforms : {1024, 65536}) {
+        suite.add("PlatformClock::sweep/platforms:" + to_string(num_platforms), [num_platforms](BenchState &state) {
+            vector<int> ids(num_platforms);
+            iota(ids.begin(), ids.end(), 0);
+            PlatformClock clock(ids, num_platforms);
+            Platform platform(0, 1, 5, 3);
+            platform.link.train = Train{'g', 0};
+            mt19937 rng(5);
+            for (int id : ids) {
+                platform.link.enter_time = rng() % 64;
+                clock.update(id, platform);
+            }
+            vector<int> due;
+            for (long long i = 0; i < state.iterations; i++) {
+                due.clear();
+                clock.sweep(3, due);
+                do_not_optimize(due.size());
+            }
+            state.items_per_iteration = num_platforms;
+        });
+    }
+
+    // saving the states of a platform with a full holding area
+    suite.add("Platform::save_all_states/queue:1024", [](BenchState &state) {
+        Platform platform = platform_with_queue(1024);
+        for (long long i = 0; i < state.iterations; i++) {
+            platform.saved_states.clear();
+            platform.save_all_states(i);
+            do_not_optimize(platform.saved_states.back());
+        }
+        state.items_per_iteration = 1024;
+    });
+
+    return suite.run(argc, argv);
+}
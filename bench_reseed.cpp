@@ -0,0 +1,81 @@
+#include "platform_load_time_gen.hpp"
+#include "sha256_simd.hpp"
+#include "bench.hpp"
+#include <bits/stdc++.h>
+using namespace std;
+
+// generator and reseed benchmarks: the 512 hash chain of PlatformLoadTimeGen::reseed done each way, the raw
+// sha256_transform, and whole draws at different popularities
+
+uint64_t sha256_functions_chain(uint64_t seed, uint64_t increment) {
+    SHA256_CTX ctx;
+    std::array<BYTE, 32> hash;
+    for (short i = 0; i < ITER; i++) {
+        seed = seed + increment;
+        std::array<BYTE, sizeof(seed)> byte_arr;
+        std::memcpy(byte_arr.data(), &seed, sizeof(seed));
+        sha256_init(ctx);
+        sha256_update(ctx, byte_arr.data(), sizeof(byte_arr));
+        sha256_final(ctx, hash);
+        for (short j = 0; j < 32; j += 8) seed ^= *(uint64_t *)(&hash[j]);
+    }
+    return seed;
+}
+
+int main(int argc, char *argv[]) {
+    constexpr int n = 256;
+    vector<uint64_t> seeds(n), increments(n);
+    mt19937_64 rng(1);
+    for (int i = 0; i < n; i++) {
+        seeds[i] = rng();
+        increments[i] = rng() >> 32;
+    }
+
+    BenchSuite suite;
+
+    suite.add("sha256_transform", [&](BenchState &state) {
+        SHA256_CTX ctx;
+        sha256_init(ctx);
+        std::array<BYTE, 64> block{};
+        for (long long i = 0; i < state.iterations; i++) {
+            block[0] = i;
+            sha256_transform(ctx, block);
+        }
+        do_not_optimize(ctx.state);
+        state.bytes_per_iteration = 64;
+    });
+
+    // one reseed per iteration
+    auto chain_bench = [&](uint64_t (*chain)(uint64_t, uint64_t)) {
+        return [&, chain](BenchState &state) {
+            uint64_t sink = 0;
+            for (long long i = 0; i < state.iterations; i++) sink ^= chain(seeds[i % n], increments[i % n]);
+            do_not_optimize(sink);
+            state.items_per_iteration = 1;
+        };
+    };
+    suite.add("reseed/sha256_init_update_final", chain_bench(sha256_functions_chain));
+    suite.add("reseed/fixed_portable", chain_bench(sha256_fixed::chain_portable));
+    if (sha256_fixed::cpu_has_sha()) suite.add("reseed/fixed_shani", chain_bench(sha256_fixed::chain_shani));
+
+    // n reseeds per iteration, a kernel width at a time
+    suite.add("reseed/multi_buffer_x" + to_string(sha256_simd::best_kernel().lanes) + "/256", [&](BenchState &state) {
+        vector<uint64_t> batch = seeds;
+        for (long long i = 0; i < state.iterations; i++) sha256_simd::run_chains(batch.data(), increments.data(), n);
+        do_not_optimize(batch[0]);
+        state.items_per_iteration = n;
+    });
+
+    // a whole draw: the poisson waiting time and the reseed after it
+    for (int popularity : {1, 10, 100, 1000}) {
+        suite.add("PlatformLoadTimeGen::next/popularity:" + to_string(popularity), [popularity](BenchState &state) {
+            PlatformLoadTimeGen pltg(popularity);
+            int sink = 0;
+            for (long long i = 0; i < state.iterations; i++) sink += pltg.next(i);
+            do_not_optimize(sink);
+            state.items_per_iteration = 1;
+        });
+    }
+
+    return suite.run(argc, argv);
+}
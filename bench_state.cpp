@@ -0,0 +1,75 @@
+#include "state.hpp"
+#include "bench.hpp"
+#include <bits/stdc++.h>
+using namespace std;
+
+// output benchmarks: formatting and printing millions of recorded states, spread over a print window of 1000 ticks
+// printing goes to a stream that throws the bytes away, so only the formatting and sorting is measured
+
+struct NullBuf : streambuf {
+    int overflow(int c) override {
+        return c;
+    }
+
+    streamsize xsputn(const char *, streamsize n) override {
+        return n;
+    }
+};
+
+vector<string> station_names(int num_stations) {
+    vector<string> names;
+    mt19937 rng(7);
+    for (int i = 0; i < num_stations; i++) {
+        string name;
+        int len = 4 + rng() % 8;
+        for (int j = 0; j < len; j++) name += 'a' + rng() % 26;
+        names.push_back(name);
+    }
+    return names;
+}
+
+vector<State> random_states(int n, int num_stations, int ticks) {
+    vector<State> states(n);
+    mt19937 rng(11);
+    for (State &s : states) {
+        s = {"gyb"[rng() % 3], (int)(rng() % 100000), (int)(rng() % num_stations), (int)(rng() % num_stations),
+             (int)(rng() % 3), (int)(rng() % ticks)};
+    }
+    return states;
+}
+
+int main(int argc, char *argv[]) {
+    // print_all_states_ptr turns off the stdio sync itself, which resets cout's buffer, so it is done before
+    ios_base::sync_with_stdio(0);
+    NullBuf null_buf;
+    streambuf *stdout_buf = cout.rdbuf();
+
+    constexpr int ticks = 1000, num_stations = 1000;
+    vector<string> names = station_names(num_stations);
+
+    BenchSuite suite;
+
+    suite.add("state_to_string", [&](BenchState &state) {
+        vector<State> states = random_states(4096, num_stations, ticks);
+        size_t sink = 0;
+        for (long long i = 0; i < state.iterations; i++) sink += state_to_string(states[i % 4096], names).size();
+        do_not_optimize(sink);
+        state.items_per_iteration = 1;
+    });
+
+    for (int n : {1 << 16, 1 << 20, 4 << 20}) {
+        vector<State> states = random_states(n, num_stations, ticks);
+        suite.add("print_all_states_ptr/states:" + to_string(n), [states, &names, null = &null_buf](BenchState &state) {
+            vector<State> copy = states;
+            streambuf *old = cout.rdbuf(null);
+            for (long long i = 0; i < state.iterations; i++) {
+                print_all_states_ptr(copy.data(), copy.size(), ticks, ticks, names);
+            }
+            cout.rdbuf(old);
+            state.items_per_iteration = states.size();
+        });
+    }
+
+    cout.rdbuf(stdout_buf);
+    return suite.run(argc, argv);
+}
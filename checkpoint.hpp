@@ -0,0 +1,188 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "structs.hpp"
+#include "exchange.hpp"
+
+// binary checkpoints, one file per rank (<prefix>.<rank>)
+// a checkpoint is taken at a tick boundary, right after the exchange of that tick, so there are no announcements in
+// flight: every train is in one of the rank's platforms (link, platform or holding area) or in its arrival wheel. The
+// platform clock is not saved, the due ticks follow from the trains, see restore_checkpoint
+// all values are written as they are in memory, so a checkpoint can only be read back on the same kind of machine
+constexpr char CHECKPOINT_MAGIC[8] = {'T', 'R', 'A', 'I', 'N', 'C', 'K', '1'};
+
+struct CheckpointHeader {
+    char magic[8];
+    int total_processes;
+    int rank;
+    int tick;    // the next tick to run, its exchange is already done
+    int ticks;
+    int window;  // exchange window, the restarted run has to exchange on the same ticks
+    int count_of_trains_spawned;
+};
+
+class CheckpointWriter {
+  private:
+    std::ofstream out;
+
+  public:
+    explicit CheckpointWriter(const std::string &path) : out(path, std::ios::binary | std::ios::trunc) {}
+
+    bool ok() const {
+        return out.good();
+    }
+
+    template <typename T>
+    void put(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out.write((const char *)&value, sizeof(T));
+    }
+
+    template <typename T>
+    void put_vector(const std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put<uint64_t>(values.size());
+        out.write((const char *)values.data(), values.size() * sizeof(T));
+    }
+
+    bool close() {
+        out.close();
+        return !out.fail();
+    }
+};
+
+class CheckpointReader {
+  private:
+    std::ifstream in;
+
+  public:
+    explicit CheckpointReader(const std::string &path) : in(path, std::ios::binary) {}
+
+    // false once anything could not be read
+    bool ok() const {
+        return in.good();
+    }
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value{};
+        in.read((char *)&value, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> get_vector() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t size = get<uint64_t>();
+        std::vector<T> values;
+        if (!in.good()) return values;
+        values.resize(size);
+        in.read((char *)values.data(), size * sizeof(T));
+        return values;
+    }
+};
+
+// the same put / get interface over a byte buffer, for platforms that move to another rank (see rebalance)
+class BufferWriter {
+  private:
+    std::vector<char> &out;
+
+  public:
+    explicit BufferWriter(std::vector<char> &out) : out(out) {}
+
+    template <typename T>
+    void put(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const char *bytes = (const char *)&value;
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    void put_vector(const std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put<uint64_t>(values.size());
+        const char *bytes = (const char *)values.data();
+        out.insert(out.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+};
+
+class BufferReader {
+  private:
+    const char *p, *end;
+
+  public:
+    BufferReader(const char *begin, const char *end) : p(begin), end(end) {}
+
+    bool at_end() const {
+        return p >= end;
+    }
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> get_vector() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t size = get<uint64_t>();
+        std::vector<T> values(size);
+        std::memcpy(values.data(), p, size * sizeof(T));
+        p += size * sizeof(T);
+        return values;
+    }
+};
+
+inline std::string checkpoint_path(const std::string &prefix, int rank) {
+    return prefix + "." + std::to_string(rank);
+}
+
+// the trains of a platform, its timing fields and its generator. The generator must not have a reseed running
+template <typename Writer>
+void write_platform(Writer &w, Platform &platform) {
+    Link &link = platform.link;
+    w.put((char)link.train.has_value());
+    w.put(link.train.value_or(INVALID_TRAIN));
+    w.put(link.enter_time);
+
+    w.put((char)platform.train.has_value());
+    w.put(platform.train.value_or(INVALID_TRAIN));
+    w.put(platform.unloading_time);
+    w.put(platform.enter_time);
+
+    // the holding area is written in heap order, so it comes back as the same heap
+    w.put_vector(platform.pq);
+    w.put_vector(platform.saved_states);
+    w.put(platform.pltg.checkpoint_state());
+}
+
+template <typename Reader>
+void read_platform(Reader &r, Platform &platform) {
+    Link &link = platform.link;
+    bool link_busy = r.template get<char>();
+    Train link_train = r.template get<Train>();
+    link.enter_time = r.template get<int>();
+    link.train.reset();
+    if (link_busy) link.train = link_train;
+
+    bool platform_busy = r.template get<char>();
+    Train platform_train = r.template get<Train>();
+    platform.unloading_time = r.template get<int>();
+    platform.enter_time = r.template get<int>();
+    platform.train.reset();
+    if (platform_busy) platform.train = platform_train;
+
+    platform.pq = r.template get_vector<Pair>();
+    platform.saved_states = r.template get_vector<State>();
+    platform.pltg.restore_state(r.template get<uint64_t>());
+}
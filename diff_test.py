@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+
+# differential runner: runs the sequential reference engine (trains_seq) and the MPI engine (trains) on the
+# testcases and on inputs generated with gen_test.py, diffs trains against trains_seq and both against out/*.ans
+# where there is one, and reports the speedup (trains_seq time / trains time) and parallel efficiency (speedup / np)
+# of every run. The times are the ones the engines print (seq_time, mpi_time), so parsing is not counted
+# every case also runs once with --binary-output on the most processes, and trains_decode has to print the same text
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+
+# gen_test.py arguments: S max_popularity max_link_weight max_num_trains max_line_len N
+GENERATED = [
+    ["20", "5", "5", "4", "8", "200"],
+    ["60", "10", "10", "8", "20", "500"],
+    ["120", "10", "20", "20", "40", "1000", "--num_train_lines", "5"],
+    ["200", "10", "10", "30", "60", "1000", "--num_train_lines", "10"],
+]
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Diff trains against trains_seq and report speedups.")
+    parser.add_argument("--np", type=int, nargs="+", default=[1, 2, 4], help="MPI process counts to run trains with")
+    parser.add_argument("--mpirun", default="mpirun", help="mpirun command")
+    parser.add_argument(
+        "--mpirun-args", default="--oversubscribe", help="extra mpirun arguments, space separated"
+    )
+    parser.add_argument("--trains-args", default="", help="extra trains options, space separated")
+    parser.add_argument("--seeds", type=int, default=1, help="generated inputs per gen_test.py parameter set")
+    parser.add_argument("--no-generated", action="store_true", help="only run the testcases")
+    parser.add_argument("--timeout", type=float, default=600, help="seconds a single run may take")
+    return parser.parse_args()
+
+
+def run(cmd: "list[str]", timeout: float) -> "tuple[bytes, float | None, str]":
+    """returns stdout, the time the engine reported, and an error message (empty if it went fine)"""
+    try:
+        proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return b"", None, "timed out"
+    err = proc.stderr.decode(errors="replace")
+    if proc.returncode != 0:
+        return proc.stdout, None, f"exit code {proc.returncode}: {err.strip()[-200:]}"
+    m = re.search(r"(?:seq_time|mpi_time):([0-9.]+)s", err)
+    return proc.stdout, float(m.group(1)) if m else None, ""
+
+
+def cases(args: argparse.Namespace, tmp: str) -> "list[tuple[str, str, str | None]]":
+    """(name, input path, expected output path or None)"""
+    out = []
+    for path in sorted(glob.glob(os.path.join(ROOT, "testcases", "*", "*.in"))):
+        name = os.path.splitext(os.path.basename(path))[0]
+        ans = os.path.join(ROOT, "out", name + ".ans")
+        out.append((name, path, ans if os.path.exists(ans) else None))
+
+    if args.no_generated:
+        return out
+    for i, params in enumerate(GENERATED):
+        for seed in range(args.seeds):
+            name = f"gen{i}_s{seed}"
+            path = os.path.join(tmp, name + ".in")
+            with open(path, "w") as f:
+                subprocess.run(
+                    [sys.executable, os.path.join(ROOT, "gen_test.py"), *params, "--seed", str(seed + 1)],
+                    stdout=f,
+                    check=True,
+                )
+            out.append((name, path, None))
+    return out
+
+
+def main() -> None:
+    args = parse_args()
+    seq = os.path.join(ROOT, "trains_seq")
+    trains = os.path.join(ROOT, "trains")
+    decode = os.path.join(ROOT, "trains_decode")
+    for binary in (seq, trains, decode):
+        if not os.path.exists(binary):
+            sys.exit(f"{binary} is missing, run make first")
+
+    failures = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        print(f"{'case':<14} {'np':>3} {'seq_time':>10} {'mpi_time':>10} {'speedup':>8} {'efficiency':>10}  result")
+        for name, path, ans in cases(args, tmp):
+            expected = open(ans, "rb").read() if ans else None
+            seq_out, seq_time, err = run([seq, path], args.timeout)
+            result = "ok"
+            if err:
+                result = f"trains_seq failed: {err}"
+            elif expected is not None and seq_out != expected:
+                result = "trains_seq differs from " + os.path.relpath(ans, ROOT)
+            if result != "ok":
+                failures += 1
+                print(f"{name:<14} {'-':>3} {'-':>10} {'-':>10} {'-':>8} {'-':>10}  {result}")
+                continue
+
+            for np in args.np:
+                cmd = [args.mpirun, *args.mpirun_args.split(), "-np", str(np), trains, path, *args.trains_args.split()]
+                out, mpi_time, err = run(cmd, args.timeout)
+                result = "ok"
+                if err:
+                    result = f"trains failed: {err}"
+                elif out != seq_out:
+                    result = "trains differs from trains_seq"
+                if result != "ok":
+                    failures += 1
+
+                speedup = seq_time / mpi_time if seq_time and mpi_time else None
+                print(
+                    f"{name:<14} {np:>3} {seq_time or 0:>10.4f} {mpi_time or 0:>10.4f} "
+                    f"{speedup or 0:>8.2f} {(speedup or 0) / np:>10.2f}  {result}"
+                )
+
+            np = max(args.np)
+            binary = os.path.join(tmp, name + ".bin")
+            cmd = [args.mpirun, *args.mpirun_args.split(), "-np", str(np), trains, path, *args.trains_args.split()]
+            _, mpi_time, err = run(cmd + ["--binary-output=" + binary], args.timeout)
+            decoded, _, decode_err = run([decode, binary], args.timeout) if not err else (b"", None, "")
+            result = "ok"
+            if err or decode_err:
+                result = f"binary output failed: {err or decode_err}"
+            elif decoded != seq_out:
+                result = "trains_decode differs from trains_seq"
+            if result != "ok":
+                failures += 1
+            print(f"{name:<14} {np:>3} {'-':>10} {mpi_time or 0:>10.4f} {'-':>8} {'-':>10}  {result} (binary)")
+
+    print("ALL OK" if failures == 0 else f"{failures} FAILED")
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,329 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+#include <mpi.h>
+
+#include "structs.hpp"
+#include "trace.hpp"
+
+// a train arriving at platform_id of the receiving rank at tick
+struct Arrival {
+    int platform_id;
+    Train train;
+    int tick;
+};
+
+// create mpi_Arrival type
+void create_mpi_Arrival(MPI_Datatype *my_type) {
+    int num_elements = 4;
+    int block_lengths[] = {1, 1, 1, 1};
+    MPI_Datatype types[] = {MPI_INT, MPI_CHAR, MPI_INT, MPI_INT};
+    MPI_Aint offsets[] = {offsetof(Arrival, platform_id), offsetof(Arrival, train) + offsetof(Train, line),
+                          offsetof(Arrival, train) + offsetof(Train, id), offsetof(Arrival, tick)};
+    MPI_Datatype tmp;
+    MPI_Type_create_struct(num_elements, block_lengths, offsets, types, &tmp);
+    MPI_Type_create_resized(tmp, 0, sizeof(Arrival), my_type);
+    MPI_Type_commit(my_type);
+    MPI_Type_free(&tmp);
+}
+
+// moves trains to the rank that owns their destination platform
+// all trains going to the same neighbour rank between two exchanges are packed into one message, so an exchange costs
+// one message per neighbour rank (even when it is empty, the receiver needs to know that the round is done), instead
+// of one message per platform edge. Since there is only one message per neighbour per round, no tag encoding is
+// needed. Trains going to a platform of the same rank never come here
+// the neighbours and the buffers only change when platforms move, so the sends and receives are persistent requests
+// set up once over fixed buffers, and a round only fills the buffers and starts them all. A persistent send has a
+// fixed length, so every message is the full buffer, and its first element carries the number of trains in it
+// with shared memory on, a neighbour on the same node gets no message at all: every rank has a shared window with a
+// mailbox (the same buffer, header and all) for each neighbour of its node it sends to, and the neighbour reads it
+// straight from there. A round ends with one barrier of the node's ranks, after which every mailbox of the round is
+// complete
+// a round is started and finished separately, so the rank can work on its tick while the trains are in flight (see
+// simulate). Trains sent in the meantime already go into the next round's buffers: the sends alternate between two
+// buffers. A mailbox has three, since a neighbour may still read the last round's while this rank is already in the
+// next one: a rank writes a buffer again only after finishing the round after the one that used it, which waits for
+// every neighbour to have started that round, after reading
+class TrainExchange {
+  private:
+    static constexpr int SEND_BUFFERS = 2;
+    static constexpr int MAILBOX_BUFFERS = 3;
+
+    MPI_Comm comm;
+    MPI_Datatype mpi_arrival;
+    int rank;
+    const std::vector<int> &platform_which_process;
+
+    std::vector<int> out_ranks, in_ranks;
+    std::vector<int> out_index;  // rank -> index into out_ranks, -1 if not a neighbour
+    std::vector<int> out_capacity, in_capacity;  // length of the buffer of each out / in rank, header included
+    // element 0 of a buffer is the header, its platform_id the count. send_bufs holds SEND_BUFFERS of them
+    std::vector<std::vector<Arrival>> send_bufs, recv_bufs;
+    std::vector<int> send_counts;
+    std::vector<MPI_Request> recv_requests, send_requests[SEND_BUFFERS];
+    std::vector<int> recv_request_index;  // index into in_ranks of each receive request
+    std::vector<int> completed;           // scratch for MPI_Testsome / MPI_Waitsome
+    MPI_Request barrier = MPI_REQUEST_NULL;
+
+    // shared memory transport, node_comm is MPI_COMM_NULL when it is off
+    MPI_Comm node_comm = MPI_COMM_NULL;
+    std::vector<int> node_rank_of;  // rank -> rank in node_comm, -1 for ranks on other nodes
+    MPI_Win window = MPI_WIN_NULL;
+    std::vector<Arrival *> mailbox_out;  // per out rank, both buffers of its mailbox in this rank's window, or null
+    std::vector<Arrival *> mailbox_in;   // per in rank, both buffers of this rank's mailbox in its window, or null
+    int round = 0;  // rounds started
+
+    std::vector<Arrival *> out_bufs;  // per out rank, where the arrivals of this round go
+    std::vector<Arrival> received;    // arrivals handed out by the last exchange
+
+  public:
+    TrainExchange(const std::vector<int> &my_platform_ids, const std::vector<int> &platform_which_process,
+                  const std::vector<Platform> &platforms, int rank, int total_processes, MPI_Comm world,
+                  bool shared_memory = false)
+        : rank(rank), platform_which_process(platform_which_process) {
+        MPI_Comm_dup(world, &comm);
+        create_mpi_Arrival(&mpi_arrival);
+        if (shared_memory) {
+            MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+            MPI_Group group, node_group;
+            MPI_Comm_group(comm, &group);
+            MPI_Comm_group(node_comm, &node_group);
+            std::vector<int> ranks(total_processes);
+            for (int r = 0; r < total_processes; r++) ranks[r] = r;
+            node_rank_of.resize(total_processes);
+            MPI_Group_translate_ranks(group, total_processes, ranks.data(), node_group, node_rank_of.data());
+            for (int &r : node_rank_of) {
+                if (r == MPI_UNDEFINED) r = -1;
+            }
+            MPI_Group_free(&group);
+            MPI_Group_free(&node_group);
+        }
+        repartition(my_platform_ids, platforms);
+    }
+
+    ~TrainExchange() {
+        free_requests();
+        free_window();
+        if (node_comm != MPI_COMM_NULL) MPI_Comm_free(&node_comm);
+        MPI_Type_free(&mpi_arrival);
+        MPI_Comm_free(&comm);
+    }
+
+    TrainExchange(const TrainExchange &) = delete;
+    TrainExchange &operator=(const TrainExchange &) = delete;
+
+    void free_requests() {
+        for (MPI_Request &request : recv_requests) MPI_Request_free(&request);
+        recv_requests.clear();
+        recv_request_index.clear();
+        for (std::vector<MPI_Request> &requests : send_requests) {
+            for (MPI_Request &request : requests) MPI_Request_free(&request);
+            requests.clear();
+        }
+    }
+
+    // collective over the node
+    void free_window() {
+        if (window == MPI_WIN_NULL) return;
+        MPI_Win_unlock_all(window);
+        MPI_Win_free(&window);
+    }
+
+    bool on_my_node(int r) {
+        return node_comm != MPI_COMM_NULL && node_rank_of[r] >= 0;
+    }
+
+    // finds the neighbour ranks, sizes the buffers and sets up the requests (and mailboxes) for the current
+    // platform_which_process, called again after the platforms moved between ranks. Nothing may be waiting to be sent
+    // collective when shared memory is on
+    void repartition(const std::vector<int> &my_platform_ids, const std::vector<Platform> &platforms) {
+        int total_processes;
+        MPI_Comm_size(comm, &total_processes);
+        free_requests();
+        free_window();
+        out_ranks.clear();
+        in_ranks.clear();
+        send_bufs.clear();
+        recv_bufs.clear();
+        out_capacity.clear();
+        in_capacity.clear();
+        out_index.assign(total_processes, -1);
+
+        // a round never covers more ticks than the travel time of a link, and a link holds one train at a time, so an
+        // edge carries at most one train per round and the number of edges to a rank bounds the message
+        std::vector<int> out_edges(total_processes, 0), in_edges(total_processes, 0);
+        for (int id : my_platform_ids) {
+            for (int dest_platform_id : platforms[id].output_platforms.next) {
+                if (dest_platform_id < 0) continue;
+                out_edges[platform_which_process[dest_platform_id]]++;
+            }
+            for (int input_platform_id : platforms[id].input_platforms) {
+                in_edges[platform_which_process[input_platform_id]]++;
+            }
+        }
+
+        for (int r = 0; r < total_processes; r++) {
+            if (r == rank) continue;
+            if (out_edges[r] > 0) {
+                out_index[r] = out_ranks.size();
+                out_ranks.push_back(r);
+                out_capacity.push_back(out_edges[r] + 1);
+                send_bufs.emplace_back(on_my_node(r) ? 0 : SEND_BUFFERS * out_capacity.back());
+            }
+            if (in_edges[r] > 0) {
+                in_ranks.push_back(r);
+                in_capacity.push_back(in_edges[r] + 1);
+                recv_bufs.emplace_back(on_my_node(r) ? 0 : in_capacity.back());
+            }
+        }
+        send_counts.assign(out_ranks.size(), 0);
+
+        for (int i = 0; i < in_ranks.size(); i++) {
+            if (on_my_node(in_ranks[i])) continue;
+            recv_requests.emplace_back();
+            recv_request_index.push_back(i);
+            MPI_Recv_init(recv_bufs[i].data(), in_capacity[i], mpi_arrival, in_ranks[i], 0, comm, &recv_requests.back());
+        }
+        completed.resize(recv_requests.size());
+        for (int b = 0; b < SEND_BUFFERS; b++) {
+            for (int i = 0; i < out_ranks.size(); i++) {
+                if (on_my_node(out_ranks[i])) continue;
+                send_requests[b].emplace_back();
+                MPI_Send_init(send_bufs[i].data() + b * out_capacity[i], out_capacity[i], mpi_arrival, out_ranks[i], 0,
+                              comm, &send_requests[b].back());
+            }
+        }
+
+        mailbox_out.assign(out_ranks.size(), nullptr);
+        mailbox_in.assign(in_ranks.size(), nullptr);
+        round = 0;
+        if (node_comm != MPI_COMM_NULL) allocate_mailboxes();
+
+        out_bufs.resize(out_ranks.size());
+        point_out_bufs();
+    }
+
+    // the buffers the trains of round `round` go into
+    void point_out_bufs() {
+        for (int i = 0; i < out_ranks.size(); i++) {
+            if (mailbox_out[i]) {
+                out_bufs[i] = mailbox_out[i] + (round % MAILBOX_BUFFERS) * out_capacity[i];
+            } else {
+                out_bufs[i] = send_bufs[i].data() + (round % SEND_BUFFERS) * out_capacity[i];
+            }
+        }
+    }
+
+    // lays the mailboxes of this rank's node neighbours out in its window, MAILBOX_BUFFERS buffers each, and tells every
+    // node neighbour where its mailbox starts
+    void allocate_mailboxes() {
+        int node_size;
+        MPI_Comm_size(node_comm, &node_size);
+        std::vector<MPI_Aint> offset_for(node_size, -1), offset_from(node_size, -1);
+        MPI_Aint size = 0;
+        for (int i = 0; i < out_ranks.size(); i++) {
+            if (!on_my_node(out_ranks[i])) continue;
+            offset_for[node_rank_of[out_ranks[i]]] = size;
+            size += MAILBOX_BUFFERS * out_capacity[i];
+        }
+
+        Arrival *base;
+        MPI_Win_allocate_shared(size * sizeof(Arrival), sizeof(Arrival), MPI_INFO_NULL, node_comm, &base, &window);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+        MPI_Alltoall(offset_for.data(), 1, MPI_AINT, offset_from.data(), 1, MPI_AINT, node_comm);
+
+        for (int i = 0; i < out_ranks.size(); i++) {
+            if (on_my_node(out_ranks[i])) mailbox_out[i] = base + offset_for[node_rank_of[out_ranks[i]]];
+        }
+        for (int i = 0; i < in_ranks.size(); i++) {
+            if (!on_my_node(in_ranks[i])) continue;
+            int from = node_rank_of[in_ranks[i]];
+            MPI_Aint from_size;
+            int disp_unit;
+            Arrival *from_base;
+            MPI_Win_shared_query(window, from, &from_size, &disp_unit, &from_base);
+            mailbox_in[i] = from_base + offset_from[from];
+        }
+    }
+
+    bool is_local(int platform_id) {
+        return platform_which_process[platform_id] == rank;
+    }
+
+    // arrival.platform_id must belong to another rank
+    void send(const Arrival &arrival) {
+        int i = out_index[platform_which_process[arrival.platform_id]];
+        out_bufs[i][1 + send_counts[i]++] = arrival;
+    }
+
+    // starts the round: sends the trains sent since the last round to every neighbour. Trains sent from here on go
+    // into the next round
+    void start() {
+        TRACE_SCOPE(trace::POST);
+        for (int i = 0; i < out_ranks.size(); i++) out_bufs[i][0].platform_id = send_counts[i];
+        if (!recv_requests.empty()) MPI_Startall(recv_requests.size(), recv_requests.data());
+        std::vector<MPI_Request> &sends = send_requests[round % SEND_BUFFERS];
+        if (!sends.empty()) MPI_Startall(sends.size(), sends.data());
+        if (window != MPI_WIN_NULL) {
+            MPI_Win_sync(window);
+            MPI_Ibarrier(node_comm, &barrier);
+        }
+
+        round++;
+        point_out_bufs();
+        send_counts.assign(send_counts.size(), 0);
+    }
+
+    // hands the arrivals of the neighbours whose messages of the started round are already in to handle, without
+    // waiting for the others
+    template <typename F>
+    void poll(F &&handle) {
+        if (recv_requests.empty()) return;
+        int count;
+        MPI_Testsome(recv_requests.size(), recv_requests.data(), &count, completed.data(), MPI_STATUSES_IGNORE);
+        if (count != MPI_UNDEFINED) handle_received(count, handle);
+    }
+
+    // waits for the rest of the started round, and hands the arrivals not handed out by poll to handle
+    template <typename F>
+    void finish(F &&handle) {
+        TRACE_SCOPE(trace::WAITALL);
+        while (!recv_requests.empty()) {
+            int count;
+            MPI_Waitsome(recv_requests.size(), recv_requests.data(), &count, completed.data(), MPI_STATUSES_IGNORE);
+            if (count == MPI_UNDEFINED) break;
+            handle_received(count, handle);
+        }
+
+        if (window != MPI_WIN_NULL) {
+            MPI_Wait(&barrier, MPI_STATUS_IGNORE);
+            MPI_Win_sync(window);
+            int b = (round - 1) % MAILBOX_BUFFERS;
+            for (int i = 0; i < in_ranks.size(); i++) {
+                if (!mailbox_in[i]) continue;
+                const Arrival *buf = mailbox_in[i] + b * in_capacity[i];
+                for (int k = 1; k <= buf[0].platform_id; k++) handle(buf[k]);
+            }
+        }
+
+        std::vector<MPI_Request> &sends = send_requests[(round - 1) % SEND_BUFFERS];
+        MPI_Waitall(sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+    }
+
+    template <typename F>
+    void handle_received(int count, F &handle) {
+        for (int c = 0; c < count; c++) {
+            const std::vector<Arrival> &buf = recv_bufs[recv_request_index[completed[c]]];
+            for (int k = 1; k <= buf[0].platform_id; k++) handle(buf[k]);
+        }
+    }
+
+    // a whole round at once: returns the trains sent to this rank, which are cleared on the next call
+    std::vector<Arrival> &exchange() {
+        received.clear();
+        start();
+        finish([&](const Arrival &arrival) { received.push_back(arrival); });
+        return received;
+    }
+};
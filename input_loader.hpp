@@ -0,0 +1,181 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include <mpi.h>
+
+#include "input_parser.hpp"
+#include "mpi_io.hpp"
+#include "topology.hpp"
+
+// collective loader for the input file. Instead of every rank parsing the whole file, rank 0 finds the head (S, V,
+// the S station names and the S popularities, whitespace separated like the rest of the input), every rank reads and
+// parses its own block of matrix rows with MPI-IO, and only the links are allgathered. Whatever follows the matrix
+// (the lines, the ticks and the trains per line) is small, so every rank gets all of it
+// the matrix has one row per line, blank lines are skipped
+struct InputParts {
+    std::string head;  // S, V, the station names and the popularities
+    Topology topology;
+    std::string tail;  // the lines, the ticks, the trains per line and the ticks to print
+};
+
+namespace input_loader {
+
+constexpr MPI_Offset CHUNK = 1 << 16;
+
+// reads [begin, end) of the file. Collective: every rank calls it, with its own range
+inline std::string read_range(MPI_File fh, MPI_Offset begin, MPI_Offset end, MPI_Comm comm) {
+    std::string out(end - begin, '\0');
+    mpi_io::in_pieces(begin, end, comm, [&](MPI_Offset from, int count) {
+        MPI_File_read_at_all(fh, from, out.data() + (from - begin), count, MPI_CHAR, MPI_STATUS_IGNORE);
+    });
+    return out;
+}
+
+// offset of the line after the head: its 2 + 2S tokens may be split into lines any way, but the matrix has to start on
+// a line of its own. -1 if the file ends inside the head or the line of its last token goes on. Only rank 0 uses this
+inline MPI_Offset after_head(MPI_File fh, MPI_Offset file_size) {
+    std::vector<char> buf(CHUNK);
+    std::string first;  // the first token, S
+    long long tokens = 0, head_tokens = -1;
+    bool in_token = false, head_done = false;
+    for (MPI_Offset at = 0; at < file_size; at += CHUNK) {
+        int len = std::min(CHUNK, file_size - at);
+        MPI_File_read_at(fh, at, buf.data(), len, MPI_CHAR, MPI_STATUS_IGNORE);
+        for (int i = 0; i < len; i++) {
+            char c = buf[i];
+            bool space = c == ' ' || c == '\n' || c == '\r' || c == '\t';
+            if (head_done) {
+                if (c == '\n') return at + i + 1;
+                if (!space) return -1;
+            } else if (!space) {
+                if (!in_token) tokens++;
+                in_token = true;
+                if (tokens == 1) first += c;
+            } else if (in_token) {
+                in_token = false;
+                if (tokens == 1) head_tokens = 2 + 2 * std::atoll(first.c_str());
+                head_done = tokens == head_tokens;
+                if (head_done && c == '\n') return at + i + 1;
+            }
+        }
+    }
+    return head_done ? file_size : -1;
+}
+
+// first line start in [begin, end), or -1 if no line starts there
+inline MPI_Offset first_line_start(MPI_File fh, MPI_Offset begin, MPI_Offset end) {
+    std::vector<char> buf(CHUNK);
+    // a line starts at begin if the byte before it ends a line
+    for (MPI_Offset at = begin - 1; at < end - 1; at += CHUNK) {
+        int len = std::min(CHUNK, end - 1 - at);
+        MPI_File_read_at(fh, at, buf.data(), len, MPI_CHAR, MPI_STATUS_IGNORE);
+        const char *nl = (const char *)std::memchr(buf.data(), '\n', len);
+        if (nl) return at + (nl - buf.data()) + 1;
+    }
+    return -1;
+}
+
+inline std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    InputScanner in(text.data(), text.data() + text.size());
+    while (!in.at_end()) lines.push_back(in.line());
+    return lines;
+}
+
+// gathers every rank's values on every rank, in rank order
+template <typename T>
+std::vector<T> allgather_all(const std::vector<T> &mine, MPI_Datatype type, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    int count = mine.size();
+    std::vector<int> counts(size), displs(size, 0);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < size; r++) displs[r] = displs[r - 1] + counts[r - 1];
+
+    std::vector<T> out(displs[size - 1] + counts[size - 1]);
+    MPI_Allgatherv(mine.data(), count, type, out.data(), counts.data(), displs.data(), type, comm);
+    return out;
+}
+
+}  // namespace input_loader
+
+// collective over comm, every rank gets the same InputParts. Empty if the file can't be opened or its head is not S
+// names and S popularities followed by the matrix on a new line, with the reason in error
+inline std::optional<InputParts> load_input(const char *path, MPI_Comm comm, std::string &error) {
+    using namespace input_loader;
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        error = std::string("Failed to open ") + path;
+        return std::nullopt;
+    }
+    MPI_Offset file_size;
+    MPI_File_get_size(fh, &file_size);
+
+    // the head is O(S) and every rank needs all of it
+    MPI_Offset matrix_begin = 0;
+    if (rank == 0) matrix_begin = after_head(fh, file_size);
+    MPI_Bcast(&matrix_begin, 1, MPI_OFFSET, 0, comm);
+    if (matrix_begin < 0) {
+        MPI_File_close(&fh);
+        error = std::string(path) + ": expected S, V, S names and S popularities, then the matrix on a new line";
+        return std::nullopt;
+    }
+    std::string head = read_range(fh, 0, matrix_begin, comm);
+
+    InputScanner head_in(head.data(), head.data() + head.size());
+    size_t S = head_in.number<size_t>();
+
+    // every rank takes the lines that start in its equal share of the rest of the file, so it has to find the first
+    // line start in its share, and its lines run up to the first line start of the ranks after it
+    MPI_Offset share_begin = matrix_begin + (file_size - matrix_begin) * rank / size;
+    MPI_Offset share_end = matrix_begin + (file_size - matrix_begin) * (rank + 1) / size;
+    MPI_Offset start = rank == 0 ? matrix_begin : first_line_start(fh, share_begin, share_end);
+
+    std::vector<MPI_Offset> starts(size);
+    MPI_Allgather(&start, 1, MPI_OFFSET, starts.data(), 1, MPI_OFFSET, comm);
+    MPI_Offset end = file_size;
+    for (int r = rank + 1; r < size; r++) {
+        if (starts[r] != -1) {
+            end = starts[r];
+            break;
+        }
+    }
+    if (start == -1) start = end;
+    std::string block = read_range(fh, start, end, comm);
+    MPI_File_close(&fh);
+
+    // row index of the first line of the block
+    std::vector<std::string_view> lines = split_lines(block);
+    long long rows = std::count_if(lines.begin(), lines.end(), [](std::string_view l) { return !is_blank(l); });
+    long long first_row = 0;
+    MPI_Exscan(&rows, &first_row, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) first_row = 0;
+
+    // rows of the matrix become (src, dst, travel time) links, and everything after the last row goes to the tail
+    std::vector<int> links;
+    const char *rest = parse_matrix_rows(block.data(), block.data() + block.size(), first_row, S,
+                                         [&](long long src, size_t dst, int travel_time) {
+                                             links.insert(links.end(), {(int)src, (int)dst, travel_time});
+                                         });
+    std::string tail_part(rest, (const char *)block.data() + block.size());
+
+    std::vector<int> all_links = allgather_all(links, MPI_INT, comm);
+    std::vector<char> tail = allgather_all(std::vector<char>(tail_part.begin(), tail_part.end()), MPI_CHAR, comm);
+
+    // ranks hold consecutive rows, so the gathered links are already in row-major order
+    Topology topology(S);
+    for (size_t i = 0; i < all_links.size(); i += 3) topology.add_link(all_links[i], all_links[i + 1], all_links[i + 2]);
+    topology.finish();
+
+    return InputParts{std::move(head), std::move(topology), std::string(tail.begin(), tail.end())};
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <string_view>
+#include <string>
+#include <vector>
+#include <charconv>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <emmintrin.h>
+
+// read-only memory mapping of the whole input file, so parsing never copies the file into stream buffers
+class MappedFile {
+  private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+
+  public:
+    explicit MappedFile(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            size = st.st_size;
+            opened = true;
+            if (size > 0) {
+                void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    opened = false;
+                    size = 0;
+                } else {
+                    data = (const char *)p;
+                    madvise(p, size, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data) munmap((void *)data, size);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool is_open() const {
+        return opened;
+    }
+
+    const char *begin() const {
+        return data;
+    }
+
+    const char *end() const {
+        return data + size;
+    }
+};
+
+// whitespace separated tokens of a mapped file. Numbers go through std::from_chars, and words and lines come out as
+// string_views into the mapping, so they are only valid as long as the MappedFile is
+class InputScanner {
+  private:
+    const char *p, *end;
+
+    // tokens are mostly one space apart, so the first character is checked on its own, and longer runs of whitespace
+    // (blank lines, indentation) are skipped 16 bytes at a time
+    void skip_space() {
+        if (p < end && !is_space(*p)) return;
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                                      _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                                         _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')),
+                                                      _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+            unsigned not_space = ~_mm_movemask_epi8(space) & 0xffff;
+            if (not_space) {
+                p += __builtin_ctz(not_space);
+                return;
+            }
+            p += 16;
+        }
+        while (p < end && is_space(*p)) p++;
+    }
+
+  public:
+    // the whitespace between tokens, also what batch::estimate_cost counts tokens by
+    static bool is_space(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    InputScanner(const char *begin, const char *end) : p(begin), end(end) {}
+
+    template <typename T>
+    T number() {
+        skip_space();
+        T value{};
+        p = std::from_chars(p, end, value).ptr;
+        return value;
+    }
+
+    std::string_view word() {
+        skip_space();
+        const char *start = p;
+        while (p < end && !is_space(*p)) p++;
+        return std::string_view(start, p - start);
+    }
+
+    bool at_end() const {
+        return p == end;
+    }
+
+    const char *position() const {
+        return p;
+    }
+
+    // moves past the end of the current line
+    void skip_line() {
+        while (p < end && *p != '\n') p++;
+        if (p < end) p++;
+    }
+
+    // the rest of the current line, without the line break
+    std::string_view line() {
+        const char *start = p;
+        while (p < end && *p != '\n') p++;
+        std::string_view out(start, p - start);
+        if (p < end) p++;
+        if (!out.empty() && out.back() == '\r') out.remove_suffix(1);
+        return out;
+    }
+};
+
+inline bool is_blank(std::string_view line) {
+    return line.find_first_not_of(" \t\r") == std::string_view::npos;
+}
+
+// the rows of the adjacency matrix in [begin, end), one row per line and blank lines skipped, numbered from row, up to
+// row S - 1. Calls link(src, dst, travel_time) for every entry that is not 0, and returns where the line after the
+// last row starts (end if the rows run out first). trains, trains_seq and bench_parser all parse the matrix here
+template <typename F>
+const char *parse_matrix_rows(const char *begin, const char *end, long long row, size_t S, F &&link) {
+    InputScanner in(begin, end);
+    while (row < (long long)S && !in.at_end()) {
+        std::string_view line = in.line();
+        if (is_blank(line)) continue;
+
+        InputScanner cells(line.data(), line.data() + line.size());
+        for (size_t dst = 0; dst < S; dst++) {
+            int travel_time = cells.number<int>();
+            if (travel_time != 0) link(row, dst, travel_time);
+        }
+        row++;
+    }
+    return in.position();
+}
+
+// splits a line into its space separated station names, in one pass
+std::vector<std::string> extract_station_names(std::string_view line) {
+    constexpr char space_delimiter = ' ';
+    std::vector<std::string> stations{};
+    size_t start = 0;
+    while (start <= line.size()) {
+        size_t pos = line.find(space_delimiter, start);
+        if (pos == std::string_view::npos) pos = line.size();
+        if (pos > start) stations.emplace_back(line.substr(start, pos - start));
+        start = pos + 1;
+    }
+    return stations;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+
+// the colors a line can have, in the order the input lists the lines (the first V of them are used)
+enum LineColor {
+    GREEN = 'g',
+    YELLOW = 'y',
+    BLUE = 'b',
+    RED = 'r',
+    BROWN = 'w',
+    PURPLE = 'p',
+    TURQUOISE = 't',
+    PINK = 'k',
+    LIME = 'l',
+    GREY = 'e'
+};
+
+constexpr LineColor colors[] = {GREEN, YELLOW, BLUE, RED, BROWN, PURPLE, TURQUOISE, PINK, LIME, GREY};
+
+constexpr int MAX_LINES = sizeof(colors) / sizeof(colors[0]);
+
+// dense index of each line color, its position in colors[], so per-line data can live in fixed-size arrays
+constexpr std::array<signed char, 256> LINE_INDEX = [] {
+    std::array<signed char, 256> index{};
+    index.fill(-1);
+    for (int i = 0; i < MAX_LINES; i++) index[(unsigned char)colors[i]] = i;
+    return index;
+}();
+
+constexpr int line_index(char line) {
+    return LINE_INDEX[(unsigned char)line];
+}
+
+// the platform a train of each line goes to next from one platform, -1 where the line does not go on from there
+struct LineRoutes {
+    std::array<int, MAX_LINES> next;
+
+    LineRoutes() {
+        next.fill(-1);
+    }
+
+    int operator[](char line) const {
+        return next[line_index(line)];
+    }
+
+    void set(char line, int platform_id) {
+        next[line_index(line)] = platform_id;
+    }
+};
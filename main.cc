@@ -9,12 +9,20 @@
 #include <algorithm>
 #include <numeric>
 #include <optional>
+#include <filesystem>
 #include <assert.h>
 
 #define OMPI_SKIP_MPICXX 1
 #include <mpi.h>
 #include <string_view>
 
+#include "options.hpp"
+#include "input_parser.hpp"
+#include "input_loader.hpp"
+#include "topology.hpp"
+#include "lines.hpp"
+#include "batch.hpp"
+
 using std::cerr;
 using std::cout;
 using std::endl;
@@ -25,124 +33,173 @@ using std::string_view;
 using std::unordered_map;
 using std::vector;
 
-using adjacency_matrix = std::vector<std::vector<size_t>>;
-
 // Definition for simulate
 void simulate(size_t num_stations, const vector<string> &station_names, const std::vector<size_t> &popularities,
-              const adjacency_matrix &mat, const unordered_map<char, vector<string>> &station_lines, size_t ticks,
+              const Topology &topology, const unordered_map<char, vector<string>> &station_lines, size_t ticks,
               const unordered_map<char, size_t> num_trains, size_t num_ticks_to_print, size_t mpi_rank,
-              size_t total_processes);
-
-enum LineColor {
-    GREEN = 'g',
-    YELLOW = 'y',
-    BLUE = 'b',
-    RED = 'r',
-    BROWN = 'w',
-    PURPLE = 'p',
-    TURQUOISE = 't',
-    PINK = 'k',
-    LIME = 'l',
-    GREY = 'e'
-};
-
-const LineColor colors[] = {GREEN, YELLOW, BLUE, RED, BROWN, PURPLE, TURQUOISE, PINK, LIME, GREY};
-
-vector<string> extract_station_names(string &line) {
-    constexpr char space_delimiter = ' ';
-    vector<string> stations{};
-    line += ' ';
-    size_t pos;
-    while ((pos = line.find(space_delimiter)) != string::npos) {
-        stations.push_back(line.substr(0, pos));
-        line.erase(0, pos + 1);
-    }
-    return stations;
+              size_t total_processes, MPI_Comm comm, const SimOptions &options);
+
+void usage(const char *prog) {
+    std::cerr << prog << " <input_file> [options]\n"
+              << "  --partition=round-robin|line   how platforms are assigned to ranks (default round-robin)\n"
+              << "  --lookahead                    sync ranks once per shortest cross-rank link travel time\n"
+              << "  --shm-exchange                 swap trains with ranks on the same node through shared memory\n"
+              << "  --overlap                      work on platforms with no input from other ranks during the exchange\n"
+              << "  --threads=N                    threads per rank working on the rank's platforms (default 1)\n"
+              << "  --defer-reseed=N               N background threads per rank do the reseeds off the critical path\n"
+              << "  --output=FILE                  sort and write the printed states from all ranks to FILE with MPI-IO\n"
+              << "  --binary-output=FILE           write the printed states packed to FILE, trains_decode prints them\n"
+              << "  --checkpoint=PREFIX            checkpoint to PREFIX.<rank> on SIGUSR1 (and every --checkpoint-every)\n"
+              << "  --checkpoint-every=N           ticks between checkpoints, rounded up to the exchange window\n"
+              << "  --restart=PREFIX               go on from the checkpoint in PREFIX.<rank>\n"
+              << "  --rebalance=N                  every N ticks, move platforms off overloaded ranks\n"
+              << "  --rebalance-threshold=X        busiest rank load / mean load that moves them (1.2)\n"
+              << "  --trace=FILE                   write a Chrome trace of every rank's phases to FILE, with a summary\n"
+              << "  --batch=DIR                    input_file is a list of inputs to run at once, outputs in DIR\n";
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << argv[0] << " <input_file>\n";
+// parses the flags after the input file
+SimOptions parse_options(int argc, char *argv[]) {
+    SimOptions options;
+    for (int i = 2; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (arg == "--partition=round-robin") {
+            options.partitioner = Partitioner::ROUND_ROBIN;
+            options.report_partition = true;
+        } else if (arg == "--partition=line") {
+            options.partitioner = Partitioner::LINE;
+            options.report_partition = true;
+        } else if (arg == "--lookahead") {
+            options.lookahead = true;
+        } else if (arg == "--shm-exchange") {
+            options.shared_memory = true;
+        } else if (arg == "--overlap") {
+            options.overlap = true;
+        } else if (arg.starts_with("--threads=")) {
+            options.threads = std::max(1, std::atoi(arg.substr(10).data()));
+        } else if (arg.starts_with("--defer-reseed=")) {
+            options.reseed_workers = std::max(0, std::atoi(arg.substr(15).data()));
+        } else if (arg.starts_with("--output=")) {
+            options.output_path = arg.substr(9);
+        } else if (arg.starts_with("--binary-output=")) {
+            options.binary_output_path = arg.substr(16);
+        } else if (arg.starts_with("--checkpoint=")) {
+            options.checkpoint_path = arg.substr(13);
+        } else if (arg.starts_with("--checkpoint-every=")) {
+            options.checkpoint_every = std::max(0, std::atoi(arg.substr(19).data()));
+        } else if (arg.starts_with("--restart=")) {
+            options.restart_path = arg.substr(10);
+        } else if (arg.starts_with("--rebalance=")) {
+            options.rebalance_every = std::max(0, std::atoi(arg.substr(12).data()));
+        } else if (arg.starts_with("--rebalance-threshold=")) {
+            options.rebalance_threshold = std::atof(arg.substr(22).data());
+        } else if (arg.starts_with("--trace=")) {
+            options.trace_path = arg.substr(8);
+        } else if (arg.starts_with("--batch=")) {
+            options.batch_dir = arg.substr(8);
+        } else {
+            std::cerr << "Unknown option " << arg << '\n';
+            usage(argv[0]);
+            std::exit(1);
+        }
+    }
+
+    // a checkpoint holds the platforms of the rank's starting partition only
+    if (options.rebalance_every > 0 && (!options.checkpoint_path.empty() || !options.restart_path.empty())) {
+        std::cerr << "--rebalance can't be used with --checkpoint or --restart\n";
+        std::exit(1);
+    }
+    if (!options.output_path.empty() && !options.binary_output_path.empty()) {
+        std::cerr << "--output and --binary-output can't be used together\n";
         std::exit(1);
     }
+    // checkpoints, traces and outputs are one set of files per run
+    if (!options.batch_dir.empty() && (!options.checkpoint_path.empty() || !options.restart_path.empty() ||
+                                       !options.trace_path.empty() || !options.output_path.empty() ||
+                                       !options.binary_output_path.empty())) {
+        std::cerr << "--batch can't be used with --checkpoint, --restart, --trace, --output or --binary-output\n";
+        std::exit(1);
+    }
+    return options;
+}
 
+// loads one input on comm and simulates it, the times go to stderr after label. Returns 0 or the exit code
+int run(const char *path, MPI_Comm comm, const SimOptions &options, const string &label) {
     int rank, tp;
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &tp);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &tp);
+
+    double parse_start_time = MPI_Wtime();
 
-    std::ifstream ifs(argv[1], std::ios_base::in);
-    if (!ifs.is_open()) {
-        std::cerr << "Failed to open " << argv[1] << '\n';
-        std::exit(2);
+    // the ranks split the matrix rows between them, and only the links are exchanged
+    string error;
+    optional<InputParts> input = load_input(path, comm, error);
+    if (!input) {
+        if (rank == 0) std::cerr << label << error << '\n';
+        return 2;
     }
+    InputScanner in(input->head.data(), input->head.data() + input->head.size());
 
     // Read S & V
-    size_t S;
-    size_t V;
-    ifs >> S;
-    ifs >> V;
+    size_t S = in.number<size_t>();
+    size_t V = in.number<size_t>();
+    if (V > MAX_LINES) {
+        if (rank == 0) std::cerr << label << "At most " << MAX_LINES << " lines are supported, got " << V << '\n';
+        return 2;
+    }
 
     // Read station names.
-    string station;
     std::vector<string> station_names{};
     station_names.reserve(S);
     for (size_t i = 0; i < S; ++i) {
-        ifs >> station;
-        station_names.emplace_back(station);
+        station_names.emplace_back(in.word());
     }
 
     // Read P popularity
-    size_t p;
     std::vector<size_t> popularities{};
     popularities.reserve(S);
     for (size_t i = 0; i < S; ++i) {
-        ifs >> p;
-        popularities.emplace_back(p);
+        popularities.emplace_back(in.number<size_t>());
     }
 
-    // Form adjacency mat
-    adjacency_matrix mat(S, std::vector<size_t>(S));
-    for (size_t src{}; src < S; ++src) {
-        for (size_t dst{}; dst < S; ++dst) {
-            ifs >> mat[src][dst];
-        }
-    }
+    // The sparse topology, only the links of the adjacency matrix were kept
+    const Topology &topology = input->topology;
 
-    ifs.ignore();
+    // Everything after the matrix
+    in = InputScanner(input->tail.data(), input->tail.data() + input->tail.size());
 
-    string stations_buf;
     unordered_map<char, vector<string>> station_lines;
 
     for (size_t i = 0; i < V; ++i) {
-        std::getline(ifs, stations_buf);
-        vector<string> station_names = extract_station_names(stations_buf);
-        station_lines[colors[i]] = std::move(station_names);
+        station_lines[colors[i]] = extract_station_names(in.line());
     }
 
     // N time ticks
-    size_t N;
-    ifs >> N;
+    size_t N = in.number<size_t>();
 
     // number of trains per line
     unordered_map<char, size_t> num_trains;
     for (size_t i = 0; i < V; ++i) {
-        size_t line_num_trains;
-        ifs >> line_num_trains;
-        num_trains[colors[i]] = line_num_trains;
+        num_trains[colors[i]] = in.number<size_t>();
     }
 
-    size_t num_ticks_to_print;
-    ifs >> num_ticks_to_print;
+    size_t num_ticks_to_print = in.number<size_t>();
+
+    double parse_time = MPI_Wtime() - parse_start_time;
+    if (rank == 0) {
+        // one write per line, other groups print too in batch mode
+        cerr << label + "parse_time:" + std::to_string(parse_time) + "s\n" << std::flush;
+    }
 
     // Start timing with MPI_Wtime
     double start_time = MPI_Wtime();
 
     // Call student implementation
-    simulate(S, station_names, popularities, mat, station_lines, N, num_trains, num_ticks_to_print, rank, tp);
+    simulate(S, station_names, popularities, topology, station_lines, N, num_trains, num_ticks_to_print, rank, tp, comm,
+             options);
 
     // Barrier to make sure all processes are finished before timing
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(comm);
 
     // End timing with MPI_Wtime
     double end_time = MPI_Wtime();
@@ -151,10 +208,102 @@ int main(int argc, char *argv[]) {
     double total_time;
     if (rank == 0) {
         total_time = end_time - start_time;
-        cerr << std::fixed << "mpi_time:" << total_time << "s" << endl;
+        cerr << label + "mpi_time:" + std::to_string(total_time) + "s\n" << std::flush;
     }
 
+    return 0;
+}
+
+// --batch: input_file lists the inputs, which run as a job farm (see batch.hpp). Every scenario writes its states to
+// <batch_dir>/<name>.out with MPI-IO, and its times go to stderr after its name and group size
+int run_batch(const char *list, const SimOptions &options) {
+    int rank, tp;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &tp);
+
+    vector<string> inputs = batch::read_list(list);
+    std::unordered_map<string, string> output_of;
+    for (const string &input : inputs) {
+        auto [it, inserted] = output_of.emplace(batch::output_path(options.batch_dir, input), input);
+        if (!inserted) {
+            if (rank == 0) std::cerr << input << " and " << it->second << " would both write " << it->first << '\n';
+            return 1;
+        }
+    }
+    if (inputs.empty()) {
+        if (rank == 0) std::cerr << "No inputs in " << list << '\n';
+        return 2;
+    }
+
+    // rank 0 estimates, every rank sorts the same way
+    vector<double> costs(inputs.size());
+    if (rank == 0) {
+        for (size_t i = 0; i < inputs.size(); ++i) costs[i] = batch::estimate_cost(inputs[i]);
+        std::error_code error;
+        std::filesystem::create_directories(options.batch_dir, error);
+    }
+    MPI_Bcast(costs.data(), costs.size(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    vector<int> order(inputs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return costs[a] > costs[b]; });
+    vector<double> sorted_costs;
+    for (int i : order) sorted_costs.push_back(costs[i]);
+
+    // group g is the next sizes[g] ranks and starts with scenario g
+    vector<int> sizes = batch::group_sizes(sorted_costs, tp);
+    int group = 0, first = 0;
+    while (rank >= first + sizes[group]) first += sizes[group++];
+    MPI_Comm group_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, group, rank, &group_comm);
+    int group_rank;
+    MPI_Comm_rank(group_comm, &group_rank);
+
+    double start_time = MPI_Wtime();
+    int status = 0;
+    {
+        batch::Dispenser dispenser(sizes.size(), MPI_COMM_WORLD);
+        for (int next = group; next < inputs.size();) {
+            const string &input = inputs[order[next]];
+            SimOptions scenario = options;
+            scenario.output_path = batch::output_path(options.batch_dir, input);
+            string label = "scenario:" + input + " ranks:" + std::to_string(sizes[group]) + " ";
+            status = std::max(status, run(input.c_str(), group_comm, scenario, label));
+
+            if (group_rank == 0) next = dispenser.next();
+            MPI_Bcast(&next, 1, MPI_INT, 0, group_comm);
+        }
+    }
+    MPI_Comm_free(&group_comm);
+
+    MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (rank == 0) {
+        cerr << std::fixed << "batch_time:" << MPI_Wtime() - start_time << "s scenarios:" << inputs.size()
+             << " groups:" << sizes.size() << endl;
+    }
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        std::exit(1);
+    }
+    SimOptions options = parse_options(argc, argv);
+
+    if (options.threads > 1 || options.reseed_workers > 0) {
+        // only the main thread of a rank calls MPI, the pool threads just work on platforms
+        int provided;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+        if (provided < MPI_THREAD_FUNNELED) {
+            std::cerr << "MPI does not support MPI_THREAD_FUNNELED\n";
+            MPI_Abort(MPI_COMM_WORLD, 3);
+        }
+    } else {
+        MPI_Init(&argc, &argv);
+    }
+    int status = options.batch_dir.empty() ? run(argv[1], MPI_COMM_WORLD, options, "") : run_batch(argv[1], options);
+
     MPI_Finalize();
 
-    return 0;
+    return status;
 }
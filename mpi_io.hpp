@@ -0,0 +1,23 @@
+#pragma once
+#include <algorithm>
+
+#include <mpi.h>
+
+namespace mpi_io {
+
+constexpr MPI_Offset MAX_PIECE = 1 << 30;
+
+// splits [begin, end) of a file into pieces that fit the int count of the MPI-IO calls and calls piece(from, count) on
+// each. Collective: every rank of comm makes the same number of calls, with empty pieces once its own range is done,
+// so piece can use the _all read and write calls
+template <typename F>
+void in_pieces(MPI_Offset begin, MPI_Offset end, MPI_Comm comm, F &&piece) {
+    long long rounds = (end - begin + MAX_PIECE - 1) / MAX_PIECE;
+    MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    for (long long i = 0; i < rounds; i++) {
+        MPI_Offset from = std::min(end, begin + i * MAX_PIECE), to = std::min(end, from + MAX_PIECE);
+        piece(from, (int)(to - from));
+    }
+}
+
+}  // namespace mpi_io
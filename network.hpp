@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "structs.hpp"
+#include "lines.hpp"
+#include "topology.hpp"
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// the platform network of the input, shared by trains and trains_seq (so no MPI in here)
+
+// creates one platform per link, with the popularity of its station and the travel time of its link, so that the
+// platform id is the link's offset in the topology
+vector<Platform> make_platforms(const Topology& topology, const vector<size_t>& popularities) {
+    vector<Platform> platforms;
+    platforms.reserve(topology.num_links());
+    for (int src = 0; src < topology.num_stations(); src ++) {
+        for (int link = topology.links_begin(src); link < topology.links_end(src); link ++) {
+            platforms.emplace_back(src, topology.link_dest(link), popularities[src], topology.link_travel_time(link));
+        }
+    }
+    return platforms;
+}
+
+// station ids of every line, looked up once
+unordered_map<char, vector<int>> line_station_ids(const unordered_map<char, vector<string>>& station_lines,
+                                                  const StationIndex& station_index) {
+    unordered_map<char, vector<int>> out;
+    for (const auto& [line, station_line] : station_lines) out[line] = station_index.ids(station_line);
+    return out;
+}
+
+// links the platforms for each line: a -> b -> c -> ... -> z, and at each end the train turns around onto the
+// platform going back
+void link_platforms(char line, const vector<int>& stations, const Topology& topology, vector<Platform>& platforms) {
+    auto connect = [&](int from, int to) {
+        platforms[from].output_platforms.set(line, to);
+        platforms[to].input_platforms.push_back(from);
+    };
+
+    for (int i = 0; i < stations.size() - 1; i ++) {
+        if (i == 0 && i + 1 == stations.size() - 1) {
+            int pa_id = topology.platform_id(stations[0], stations[1]);
+            int pb_id = topology.platform_id(stations[1], stations[0]);
+            connect(pa_id, pb_id);
+            connect(pb_id, pa_id);
+        } else if (i == 0) {
+            int pa_id = topology.platform_id(stations[0], stations[1]);
+            int pb_id = topology.platform_id(stations[1], stations[2]);
+            connect(pa_id, pb_id);
+
+            int pc_id = topology.platform_id(stations[1], stations[0]);
+            connect(pc_id, pa_id);
+        } else if (i + 1 == stations.size() - 1) {
+            int pa_id = topology.platform_id(stations[i], stations[i + 1]);
+            int pb_id = topology.platform_id(stations[i + 1], stations[i]);
+            connect(pa_id, pb_id);
+
+            int pc_id = topology.platform_id(stations[i], stations[i - 1]);
+            connect(pb_id, pc_id);
+        } else {
+            int pa_id = topology.platform_id(stations[i], stations[i + 1]);
+            int pb_id = topology.platform_id(stations[i + 1], stations[i + 2]);
+            connect(pa_id, pb_id);
+
+            int pc_id = topology.platform_id(stations[i + 1], stations[i]);
+            int pd_id = topology.platform_id(stations[i], stations[i - 1]);
+            connect(pc_id, pd_id);
+        }
+    }
+}
+
+// for each line, get the terminal platform ids
+// idx i for the line colors[i], in input order (green, yellow, blue, ...)
+vector<vector<int>> get_terminal_platform_ids_for_each_line(const unordered_map<char, vector<int>>& line_stations,
+                                                            const Topology& topology) {
+    int num_lines = line_stations.size();
+    vector<vector<int>> out(num_lines, vector<int>());
+    for (int i = 0; i < num_lines; i ++) {
+        char line = colors[i];
+        const vector<int>& stations = line_stations.at(line);
+        int start_platform_id = topology.platform_id(stations[0], stations[1]);
+
+        int len = stations.size();
+        int end_platform_id = topology.platform_id(stations[len - 1], stations[len - 2]);
+        out[i].push_back(start_platform_id);
+        out[i].push_back(end_platform_id);
+    }
+    return out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+
+// how platforms are assigned to MPI processes
+enum class Partitioner {
+    ROUND_ROBIN,  // platform i goes to rank i % total_processes
+    LINE          // contiguous line segments, balanced on expected train arrivals
+};
+
+// command line options after the input file, see main.cc for the flags
+struct SimOptions {
+    Partitioner partitioner = Partitioner::ROUND_ROBIN;
+    bool report_partition = false;  // print edge cut and imbalance of the partition to stderr
+    bool lookahead = false;         // sync ranks once per lookahead window instead of every tick
+    bool shared_memory = false;     // neighbours on the same node swap trains through shared memory mailboxes
+    bool overlap = false;           // interior platforms take their trains in while the exchange is in flight
+    int threads = 1;                // threads per rank working on the rank's platforms
+    int reseed_workers = 0;         // background threads per rank for deferred reseeds, 0 reseeds in the tick
+    std::string output_path;        // every rank writes its share of the printed states here, empty prints on rank 0
+    std::string binary_output_path; // rank 0 writes the printed states packed here instead, see trains_decode
+    std::string checkpoint_path;    // checkpoints go to <checkpoint_path>.<rank>, on SIGUSR1 and every checkpoint_every
+    int checkpoint_every = 0;       // ticks between checkpoints, 0 only checkpoints on SIGUSR1
+    std::string restart_path;       // go on from the checkpoint <restart_path>.<rank>
+    int rebalance_every = 0;        // ticks between load checks that may move platforms between ranks, 0 never
+    double rebalance_threshold = 1.2;  // move platforms when the busiest rank has this much times the mean load
+    std::string trace_path;         // rank 0 writes the Chrome trace of every rank's phases here
+    std::string batch_dir;          // the input file lists inputs, run as a job farm with outputs in this directory
+};
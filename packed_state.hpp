@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "state.hpp"
+#include "lines.hpp"
+
+// 8 byte form of a State, for shipping the recorded states between ranks and into binary output files
+// the two stations come from the platform the state was recorded on (a platform is one direction of a link, its
+// holding area and platform are at the link's src station), and the tick from the block the state is in
+// bits 0-3 line index, 4-5 status, 6-34 train id, 35-63 platform id
+struct PackedState {
+    uint64_t bits;
+
+    static constexpr int ID_BITS = 29, PLATFORM_BITS = 29;
+
+    // whether the ids of num_trains trains and num_platforms platforms fit the fields, checked before the run starts
+    static bool fits(size_t num_trains, size_t num_platforms) {
+        return num_trains <= (size_t)1 << ID_BITS && num_platforms <= (size_t)1 << PLATFORM_BITS;
+    }
+
+    static PackedState pack(const State &state, int platform) {
+        return {(uint64_t)line_index(state.line) | (uint64_t)state.status << 4 | (uint64_t)state.id << 6 |
+                (uint64_t)platform << (6 + ID_BITS)};
+    }
+
+    int line() const {
+        return bits & 0xf;
+    }
+
+    int status() const {
+        return bits >> 4 & 0x3;
+    }
+
+    int id() const {
+        return bits >> 6 & ((1u << ID_BITS) - 1);
+    }
+
+    int platform() const {
+        return bits >> (6 + ID_BITS);
+    }
+};
+
+static_assert(sizeof(PackedState) == 8);
+
+// src and dest station of every platform, what unpacking needs
+struct PlatformStations {
+    std::vector<int> src, dest;
+
+    State unpack(PackedState packed, int tick) const {
+        int platform = packed.platform();
+        return {(char)colors[packed.line()], packed.id(), src[platform], dest[platform], packed.status(), tick};
+    }
+};
+
+// the packed states of ticks [begin, begin + counts.size()), tick-major: counts[t] states of tick begin + t, then the
+// ones of the next tick. The order within a tick does not matter, formatting sorts them
+struct PackedTicks {
+    int begin = 0;
+    std::vector<int> counts;
+    std::vector<PackedState> states;
+
+    std::vector<State> unpack(const PlatformStations &stations) const {
+        std::vector<State> out;
+        out.reserve(states.size());
+        size_t i = 0;
+        for (int t = 0; t < counts.size(); t++) {
+            for (int n = 0; n < counts[t]; n++) out.push_back(stations.unpack(states[i++], begin + t));
+        }
+        return out;
+    }
+};
+
+// binary output: the printed window as packed states, for tools that would rather not parse the text (trains_decode
+// turns it back into the text). All fields little endian
+//   "TRAINPK1"
+//   int32 number of stations, then per station int32 length and the name
+//   int32 number of platforms, then per platform int32 src and int32 dest station
+//   int32 first tick, int32 number of ticks, then per tick int32 number of states
+//   the packed states, uint64 each, tick-major
+namespace state_file {
+
+constexpr char MAGIC[8] = {'T', 'R', 'A', 'I', 'N', 'P', 'K', '1'};
+
+inline bool write(const std::string &path, const std::vector<std::string> &station_names,
+                  const PlatformStations &stations, const PackedTicks &ticks) {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    auto put_int = [&](int32_t v) { std::fwrite(&v, sizeof(v), 1, f); };
+
+    std::fwrite(MAGIC, 1, sizeof(MAGIC), f);
+    put_int(station_names.size());
+    for (const std::string &name : station_names) {
+        put_int(name.size());
+        std::fwrite(name.data(), 1, name.size(), f);
+    }
+    put_int(stations.src.size());
+    for (int i = 0; i < stations.src.size(); i++) {
+        put_int(stations.src[i]);
+        put_int(stations.dest[i]);
+    }
+    put_int(ticks.begin);
+    put_int(ticks.counts.size());
+    std::fwrite(ticks.counts.data(), sizeof(int32_t), ticks.counts.size(), f);
+    std::fwrite(ticks.states.data(), sizeof(PackedState), ticks.states.size(), f);
+    return std::fclose(f) == 0;
+}
+
+// reads a states file: the station names, the platforms and the tick counts when it is opened, then the states a
+// chunk at a time, so a reader never has to hold the whole file
+class Reader {
+  private:
+    FILE *f = nullptr;
+    bool good = false;
+
+    bool get(void *out, size_t size, size_t n) {
+        good = good && std::fread(out, size, n, f) == n;
+        return good;
+    }
+
+    int get_int() {
+        int32_t v = 0;
+        get(&v, sizeof(v), 1);
+        if (v < 0) good = false;
+        return good ? v : 0;
+    }
+
+  public:
+    std::vector<std::string> station_names;
+    PlatformStations stations;
+    int begin = 0;
+    std::vector<int> counts;  // states of each tick
+
+    explicit Reader(const std::string &path) : f(std::fopen(path.c_str(), "rb")), good(f != nullptr) {
+        char magic[sizeof(MAGIC)];
+        good = get(magic, 1, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+
+        station_names.resize(get_int());
+        for (std::string &name : station_names) {
+            name.resize(get_int());
+            get(name.data(), 1, name.size());
+        }
+        int num_platforms = get_int();
+        stations.src.resize(num_platforms);
+        stations.dest.resize(num_platforms);
+        for (int i = 0; i < num_platforms && good; i++) {
+            stations.src[i] = get_int();
+            stations.dest[i] = get_int();
+            good = good && stations.src[i] < station_names.size() && stations.dest[i] < station_names.size();
+        }
+
+        // begin can be anything, the rest are counts
+        get(&begin, sizeof(int32_t), 1);
+        counts.resize(get_int());
+        for (int &count : counts) count = get_int();
+    }
+
+    ~Reader() {
+        if (f) std::fclose(f);
+    }
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    // false if the file is missing, cut short or not a states file
+    bool ok() const {
+        return good;
+    }
+
+    // the next n states into out, false if the file is cut short or a state is out of range
+    bool read(size_t n, std::vector<PackedState> &out) {
+        out.resize(good ? n : 0);
+        get(out.data(), sizeof(PackedState), out.size());
+        for (PackedState packed : out) {
+            good = good && packed.platform() < stations.src.size() && packed.line() < MAX_LINES && packed.status() <= 2;
+        }
+        return good;
+    }
+};
+
+}  // namespace state_file
@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <numeric>
+
+#include "structs.hpp"
+
+using std::vector;
+
+struct PartitionStats {
+    long long cut_edges;    // platform edges whose two platforms are on different ranks
+    long long total_edges;
+    double imbalance;       // heaviest rank weight / average rank weight
+};
+
+// undirected platform graph built from output_platforms and input_platforms, without duplicate edges
+vector<vector<int>> platform_graph(const vector<Platform> &platforms) {
+    vector<vector<int>> adj(platforms.size());
+    for (int id = 0; id < platforms.size(); id++) {
+        for (int dest : platforms[id].output_platforms.next) {
+            if (dest >= 0) adj[id].push_back(dest);
+        }
+        for (int src : platforms[id].input_platforms) adj[id].push_back(src);
+    }
+    for (vector<int> &nbrs : adj) {
+        std::sort(nbrs.begin(), nbrs.end());
+        nbrs.erase(std::unique(nbrs.begin(), nbrs.end()), nbrs.end());
+    }
+    return adj;
+}
+
+// recursively bisects order[lo, hi) into parts [first_part, first_part + num_parts), so that each side gets weight
+// proportional to the number of parts it holds. order follows the lines, so every part is a contiguous line segment
+void bisect(const vector<int> &order, const vector<long long> &prefix, int lo, int hi, int first_part, int num_parts,
+            vector<int> &owner) {
+    if (num_parts == 1) {
+        for (int i = lo; i < hi; i++) owner[order[i]] = first_part;
+        return;
+    }
+
+    int left_parts = num_parts / 2;
+    long long target = prefix[lo] + (prefix[hi] - prefix[lo]) * left_parts / num_parts;
+
+    // first cut point whose left side reaches the target, then take the closer of it and the one before
+    int mid = std::lower_bound(prefix.begin() + lo, prefix.begin() + hi + 1, target) - prefix.begin();
+    if (mid > lo && target - prefix[mid - 1] < prefix[mid] - target) mid--;
+    mid = std::clamp(mid, lo, hi);
+
+    bisect(order, prefix, lo, mid, first_part, left_parts, owner);
+    bisect(order, prefix, mid, hi, first_part + left_parts, num_parts - left_parts, owner);
+}
+
+// greedy boundary refinement: move a platform to the part most of its neighbours are in, as long as that removes cut
+// edges and keeps the destination part within the allowed weight
+void refine(const vector<vector<int>> &adj, const vector<long long> &weights, int num_parts, double max_imbalance,
+            vector<int> &owner) {
+    vector<long long> part_weight(num_parts, 0);
+    for (int id = 0; id < owner.size(); id++) part_weight[owner[id]] += weights[id];
+    long long total = std::accumulate(part_weight.begin(), part_weight.end(), 0LL);
+    long long max_weight = (long long)(max_imbalance * total / num_parts) + 1;
+
+    vector<int> links_to(num_parts, 0);
+    for (int pass = 0; pass < 8; pass++) {
+        int moves = 0;
+        for (int id = 0; id < owner.size(); id++) {
+            int from = owner[id];
+            for (int nbr : adj[id]) links_to[owner[nbr]]++;
+
+            int best = from;
+            for (int nbr : adj[id]) {
+                int to = owner[nbr];
+                if (links_to[to] > links_to[best] && part_weight[to] + weights[id] <= max_weight) best = to;
+            }
+            for (int nbr : adj[id]) links_to[owner[nbr]] = 0;
+
+            // never empty a part, every rank must keep at least some work
+            if (best == from || part_weight[from] == weights[id]) continue;
+            owner[id] = best;
+            part_weight[from] -= weights[id];
+            part_weight[best] += weights[id];
+            moves++;
+        }
+        if (moves == 0) break;
+    }
+}
+
+// assigns platforms to num_parts ranks. line_loops holds, for each line, the platforms in the order a train visits
+// them (out to one terminal and back); weights is the expected work (train arrivals) of each platform
+vector<int> line_partition(const vector<Platform> &platforms, const vector<vector<int>> &line_loops,
+                           const vector<long long> &weights, int num_parts) {
+    // lay the lines end to end, every platform at its first visit, platforms on no line at the end
+    vector<int> order;
+    vector<char> placed(platforms.size(), 0);
+    for (const vector<int> &loop : line_loops) {
+        for (int id : loop) {
+            if (placed[id]) continue;
+            placed[id] = 1;
+            order.push_back(id);
+        }
+    }
+    for (int id = 0; id < platforms.size(); id++) {
+        if (!placed[id]) order.push_back(id);
+    }
+
+    vector<long long> prefix(order.size() + 1, 0);
+    for (int i = 0; i < order.size(); i++) prefix[i + 1] = prefix[i] + weights[order[i]];
+
+    vector<int> owner(platforms.size(), 0);
+    bisect(order, prefix, 0, order.size(), 0, num_parts, owner);
+    refine(platform_graph(platforms), weights, num_parts, 1.05, owner);
+    return owner;
+}
+
+PartitionStats evaluate_partition(const vector<Platform> &platforms, const vector<int> &owner,
+                                  const vector<long long> &weights, int num_parts) {
+    PartitionStats stats = {0, 0, 1.0};
+    for (int id = 0; id < platforms.size(); id++) {
+        for (int dest : platforms[id].output_platforms.next) {
+            if (dest < 0) continue;
+            stats.total_edges++;
+            if (owner[id] != owner[dest]) stats.cut_edges++;
+        }
+    }
+
+    vector<long long> part_weight(num_parts, 0);
+    for (int id = 0; id < platforms.size(); id++) part_weight[owner[id]] += weights[id];
+    long long total = std::accumulate(part_weight.begin(), part_weight.end(), 0LL);
+    if (total > 0) stats.imbalance = (double)*std::max_element(part_weight.begin(), part_weight.end()) * num_parts / total;
+    return stats;
+}
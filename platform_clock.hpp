@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <climits>
+#include <emmintrin.h>
+
+#include "structs.hpp"
+
+// the hot timing state of the platforms of one rank, in one contiguous array apart from the Platform objects (whose
+// generator alone is a few KB), so finding the platforms that have something to do reads 4 bytes per platform
+// release[slot] is the first tick at which the platform in that slot can move a train in send_out: while its link
+// holds a train that is when the train is done travelling (a train done unloading waits for the link anyway),
+// otherwise when the train on its platform is done unloading, and NEVER when both are empty
+class PlatformClock {
+  private:
+    static constexpr int NEVER = INT_MAX;
+    static constexpr int BLOCK = 16;
+
+    std::vector<int> ids;      // platform id of each slot, in increasing order
+    std::vector<int> slot_of;  // slot of each platform id, -1 for platforms of other ranks
+    std::vector<int> release;  // padded with NEVER to a multiple of BLOCK
+
+  public:
+    PlatformClock(const std::vector<int> &my_platform_ids, int num_platforms)
+        : ids(my_platform_ids), slot_of(num_platforms, -1),
+          release((my_platform_ids.size() + BLOCK - 1) / BLOCK * BLOCK, NEVER) {
+        for (int slot = 0; slot < ids.size(); slot++) slot_of[ids[slot]] = slot;
+    }
+
+    // must be called whenever a train enters or leaves the link or the platform
+    void update(int id, const Platform &platform) {
+        int &r = release[slot_of[id]];
+        if (platform.link.train.has_value()) {
+            r = platform.link.enter_time + platform.link.travel_time;
+        } else if (platform.train.has_value()) {
+            r = platform.enter_time + platform.unloading_time;
+        } else {
+            r = NEVER;
+        }
+    }
+
+    // appends the platforms with release <= tick to out, in id order
+    // 4 slots per SSE2 compare, and a block of 16 where no platform is due costs 4 compares and one branch
+    void sweep(int tick, std::vector<int> &out) const {
+        __m128i now = _mm_set1_epi32(tick);
+        for (int s = 0; s < release.size(); s += BLOCK) {
+            const int *p = release.data() + s;
+            unsigned later = 0;
+            for (int q = 0; q < 4; q++) {
+                __m128i r = _mm_loadu_si128((const __m128i *)(p + 4 * q));
+                later |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(r, now))) << (4 * q);
+            }
+            unsigned due = ~later & 0xffff;
+            while (due) {
+                out.push_back(ids[s + __builtin_ctz(due)]);
+                due &= due - 1;
+            }
+        }
+    }
+};
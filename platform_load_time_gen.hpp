@@ -3,6 +3,9 @@
 #include <random>
 #include <array>
 #include <cstring>
+#include <atomic>
+#include <cpuid.h>
+#include <immintrin.h>
 #define ITER 512
 
 /*
@@ -164,33 +167,185 @@ void sha256_final(SHA256_CTX &ctx, std::array<BYTE, 32> &hash) {
 
 // ============= END SHA-256 SECTION =============
 
+/*
+ * ======== FIXED-LENGTH SHA256 FAST PATH ========
+ * reseed only ever hashes the 8 little endian bytes of a 64 bit seed. That is always exactly one block: the 8 bytes
+ * (big endian words w0 and w1), the 0x80 pad byte, zeros, and the bit length 64. So the padding, the length and every
+ * part of the message schedule that only depends on them are worked out at compile time, and the hash is a single
+ * compression from the fixed initial state. Uses the x86 SHA extensions when the CPU has them
+ */
+namespace sha256_fixed {
+
+constexpr std::array<WORD, 8> H0{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// block words 2 to 15 are fixed, words 0 and 1 (and every schedule word after 15) depend on the seed
+constexpr bool is_variable(int i) { return i < 2 || i >= 16; }
+
+constexpr WORD block_word(int i) { return i == 2 ? 0x80000000 : i == 15 ? 64 : 0; }
+
+// part of schedule word i (16 <= i < 64) that only comes from the fixed block words
+constexpr std::array<WORD, 64> schedule_constants() {
+    std::array<WORD, 64> c{};
+    for (int i = 16; i < 64; i++) {
+        if (!is_variable(i - 2)) c[i] += SIG1(block_word(i - 2));
+        if (!is_variable(i - 7)) c[i] += block_word(i - 7);
+        if (!is_variable(i - 15)) c[i] += SIG0(block_word(i - 15));
+        if (!is_variable(i - 16)) c[i] += block_word(i - 16);
+    }
+    return c;
+}
+
+// k[i] + m[i] for the rounds whose message word is fixed
+constexpr std::array<WORD, 64> round_constants() {
+    std::array<WORD, 64> kw = k;
+    for (int i = 2; i < 16; i++) kw[i] += block_word(i);
+    return kw;
+}
+
+constexpr std::array<WORD, 64> C = schedule_constants();
+constexpr std::array<WORD, 64> KW = round_constants();
+
+// what reseed does with a digest: read it back as four little endian 64 bit words, and xor them together
+inline uint64_t fold(const WORD *state) {
+    WORD lo = __builtin_bswap32(state[0] ^ state[2] ^ state[4] ^ state[6]);
+    WORD hi = __builtin_bswap32(state[1] ^ state[3] ^ state[5] ^ state[7]);
+    return ((uint64_t)hi << 32) | lo;
+}
+
+inline uint64_t hash_portable(uint64_t seed) {
+    std::array<WORD, 64> m;
+    m[0] = __builtin_bswap32((WORD)seed);
+    m[1] = __builtin_bswap32((WORD)(seed >> 32));
+    // fully unrolled, so that is_variable is decided at compile time and the fixed words drop out
+#pragma GCC unroll 64
+    for (int i = 16; i < 64; i++) {
+        WORD w = C[i];
+        if (is_variable(i - 2)) w += SIG1(m[i - 2]);
+        if (is_variable(i - 7)) w += m[i - 7];
+        if (is_variable(i - 15)) w += SIG0(m[i - 15]);
+        if (is_variable(i - 16)) w += m[i - 16];
+        m[i] = w;
+    }
+
+    WORD a = H0[0], b = H0[1], c = H0[2], d = H0[3], e = H0[4], f = H0[5], g = H0[6], h = H0[7];
+#pragma GCC unroll 64
+    for (int i = 0; i < 64; ++i) {
+        WORD t1 = h + EP1(e) + CH(e, f, g) + KW[i] + (is_variable(i) ? m[i] : 0);
+        WORD t2 = EP0(a) + MAJ(a, b, c);
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    WORD state[8] = {a + H0[0], b + H0[1], c + H0[2], d + H0[3], e + H0[4], f + H0[5], g + H0[6], h + H0[7]};
+    return fold(state);
+}
+
+__attribute__((target("sha,sse4.1"))) inline uint64_t hash_shani(uint64_t seed) {
+    // the SHA instructions keep the state as ABEF and CDGH
+    const __m128i abef_init = _mm_set_epi32(H0[0], H0[1], H0[4], H0[5]);
+    const __m128i cdgh_init = _mm_set_epi32(H0[2], H0[3], H0[6], H0[7]);
+    __m128i state0 = abef_init, state1 = cdgh_init;
+
+    // four message words per register, the word of the earliest round in the lowest lane
+    __m128i msg[4] = {
+        _mm_set_epi32(0, 0x80000000, __builtin_bswap32((WORD)(seed >> 32)), __builtin_bswap32((WORD)seed)),
+        _mm_setzero_si128(),
+        _mm_setzero_si128(),
+        _mm_set_epi32(64, 0, 0, 0),
+    };
+
+    for (int i = 0; i < 16; i++) {
+        __m128i &cur = msg[i % 4];
+        __m128i wk = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *)&k[4 * i]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+
+        // finish the next four schedule words, then start on the four after the next three
+        if (i >= 3 && i < 15) {
+            __m128i &next = msg[(i + 1) % 4];
+            next = _mm_add_epi32(next, _mm_alignr_epi8(cur, msg[(i + 3) % 4], 4));
+            next = _mm_sha256msg2_epu32(next, cur);
+        }
+        wk = _mm_shuffle_epi32(wk, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+        if (i >= 1 && i < 13) msg[(i + 3) % 4] = _mm_sha256msg1_epu32(msg[(i + 3) % 4], cur);
+    }
+
+    state0 = _mm_add_epi32(state0, abef_init);
+    state1 = _mm_add_epi32(state1, cdgh_init);
+
+    // back to ABCD and EFGH
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(state1, 0xB1);
+    WORD state[8];
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+    return fold(state);
+}
+
+// the reseed loop: ITER rounds of adding increment to the seed, hashing it, and xoring the folded digest back in
+inline uint64_t chain_portable(uint64_t seed, uint64_t increment) {
+    for (int i = 0; i < ITER; i++) {
+        seed += increment;
+        seed ^= hash_portable(seed);
+    }
+    return seed;
+}
+
+__attribute__((target("sha,sse4.1"))) inline uint64_t chain_shani(uint64_t seed, uint64_t increment) {
+    for (int i = 0; i < ITER; i++) {
+        seed += increment;
+        seed ^= hash_shani(seed);
+    }
+    return seed;
+}
+
+inline bool cpu_has_sha() {
+    static const bool has_sha = [] {
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+        bool sha = ebx & (1u << 29);
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        bool sse41 = ecx & (1u << 19);
+        return sha && sse41;
+    }();
+    return has_sha;
+}
+
+inline uint64_t chain(uint64_t seed, uint64_t increment) {
+    return cpu_has_sha() ? chain_shani(seed, increment) : chain_portable(seed, increment);
+}
+
+}  // namespace sha256_fixed
+
+// ======= END FIXED-LENGTH SHA256 FAST PATH =======
+
 class PlatformLoadTimeGen {
   private:
     int popularity;
     std::mt19937_64 gen;
     uint64_t last_value;
 
+    // a reseed that next_deferred left for later. Another thread can take it on (try_claim, then complete_reseed), so
+    // the state is atomic: IDLE, PENDING (nobody is on it) or RUNNING (someone is)
+    enum { IDLE, PENDING, RUNNING };
+    std::atomic<int> reseed_state{IDLE};
+    uint64_t pending_entropy = 0;
+
     void reseed(uint64_t entropy) {
-        SHA256_CTX ctx;
-        std::array<BYTE, 32> hash;
         // Linear congruential generator XDD
         uint64_t combined_seed = entropy ^ (last_value * 6364136223846793005ULL);
 
         // artificial workload for generating deterministic loading times, do not change!
-        for (short i = 0; i < ITER; i++) {
-            combined_seed = combined_seed + (last_value >> 32);
-            std::array<BYTE, sizeof(combined_seed)> byte_arr;
-            std::memcpy(byte_arr.data(), &combined_seed, sizeof(combined_seed));
-
-            sha256_init(ctx);
-            sha256_update(ctx, byte_arr.data(), sizeof(byte_arr));
-            sha256_final(ctx, hash);
-
-            for (short j = 0; j < 32; j += 8) {
-                uint64_t *hash_part = (uint64_t *)(&hash[j]);
-                combined_seed ^= *hash_part;
-            }
-        }
+        // ITER rounds of combined_seed += last_value >> 32, then xor in the sha256 of its 8 bytes, read back as four
+        // 64 bit words. sha256_fixed gives the same bits as sha256_init/update/final (see test_reseed.cpp)
+        combined_seed = sha256_fixed::chain(combined_seed, last_value >> 32);
 
         gen.seed(combined_seed);
         last_value = combined_seed;
@@ -199,11 +354,91 @@ class PlatformLoadTimeGen {
   public:
     PlatformLoadTimeGen(int popularity) : popularity(popularity), gen(3210), last_value(3210) {}
 
+    // copies are only made while the platforms are set up, with no reseed running
+    PlatformLoadTimeGen(const PlatformLoadTimeGen &other)
+        : popularity(other.popularity), gen(other.gen), last_value(other.last_value),
+          reseed_state(other.reseed_state.load()), pending_entropy(other.pending_entropy) {}
+
+    PlatformLoadTimeGen &operator=(const PlatformLoadTimeGen &other) {
+        popularity = other.popularity;
+        gen = other.gen;
+        last_value = other.last_value;
+        reseed_state.store(other.reseed_state.load());
+        pending_entropy = other.pending_entropy;
+        return *this;
+    }
+
     int next(int train_id) {
+        settle();
         // min waiting time & popularity must be 1
         std::poisson_distribution<int> dist(popularity - 1);
         int next_waiting_time = dist(gen) + 1;
         reseed(train_id);
         return next_waiting_time;
     }
+
+    // same as next, but the reseed is left pending, so that it can be batched with the reseeds of other generators
+    // (see reseed_batch) or done in the background (see Reseeder). A pending reseed that nobody took on is done at the
+    // start of the next draw, and one that is still running is waited for
+    int next_deferred(int train_id) {
+        settle();
+        std::poisson_distribution<int> dist(popularity - 1);
+        int next_waiting_time = dist(gen) + 1;
+        pending_entropy = train_id;
+        reseed_state.store(PENDING, std::memory_order_release);
+        return next_waiting_time;
+    }
+
+    bool has_pending_reseed() const {
+        return reseed_state.load(std::memory_order_acquire) == PENDING;
+    }
+
+    // takes on the pending reseed, false if there is none or someone else already has it
+    // whoever claims it must call complete_reseed
+    bool try_claim() {
+        int expected = PENDING;
+        return reseed_state.compare_exchange_strong(expected, RUNNING, std::memory_order_acq_rel);
+    }
+
+    // the reseed chain of the pending reseed starts from pending_seed, and adds pending_increment before every hash
+    uint64_t pending_seed() const {
+        return pending_entropy ^ (last_value * 6364136223846793005ULL);
+    }
+
+    uint64_t pending_increment() const {
+        return last_value >> 32;
+    }
+
+    // finishes the claimed reseed with the final seed of its chain
+    void complete_reseed(uint64_t combined_seed) {
+        gen.seed(combined_seed);
+        last_value = combined_seed;
+        reseed_state.store(IDLE, std::memory_order_release);
+        reseed_state.notify_all();
+    }
+
+    // every draw is followed by a reseed, so with no reseed outstanding the generator is always freshly seeded with
+    // last_value, and last_value is all there is to save in a checkpoint
+    uint64_t checkpoint_state() {
+        settle();
+        return last_value;
+    }
+
+    void restore_state(uint64_t value) {
+        last_value = value;
+        gen.seed(value);
+        reseed_state.store(IDLE);
+    }
+
+    // makes sure no reseed is outstanding: does a pending one here, or waits for the thread that is running it
+    void settle() {
+        if (try_claim()) {
+            reseed(pending_entropy);
+            reseed_state.store(IDLE, std::memory_order_release);
+            reseed_state.notify_all();
+            return;
+        }
+        int state;
+        while ((state = reseed_state.load(std::memory_order_acquire)) != IDLE) reseed_state.wait(state);
+    }
 };
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "platform_load_time_gen.hpp"
+#include "sha256_simd.hpp"
+
+// background workers for deferred reseeds
+// the reseed after a train enters a platform only matters to the next train entering that platform, which is at least
+// the unloading time away. So instead of doing it on the spot, the rank queues it here and moves on (to the rest of
+// the tick, and then to MPI_Waitall), while the workers drain the queue a kernel width at a time. A generator that is
+// drawn from again before its reseed was done either does it itself, or waits for the worker that is on it
+class Reseeder {
+  private:
+    static constexpr int BATCH = 16;
+
+    std::vector<std::thread> workers;
+    std::deque<PlatformLoadTimeGen *> queue;
+    int busy = 0;  // workers in the middle of a batch
+    bool stopping = false;
+    std::mutex m;
+    std::condition_variable work_cv, idle_cv;
+
+    void worker_loop() {
+        std::vector<PlatformLoadTimeGen *> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                if (!batch.empty()) {
+                    busy--;
+                    if (queue.empty() && busy == 0) idle_cv.notify_all();
+                }
+                work_cv.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (stopping) return;
+
+                batch.clear();
+                while (!queue.empty() && batch.size() < BATCH) {
+                    batch.push_back(queue.front());
+                    queue.pop_front();
+                }
+                busy++;
+            }
+            reseed_batch(batch.data(), batch.size());
+        }
+    }
+
+  public:
+    explicit Reseeder(int num_workers) {
+        for (int i = 0; i < num_workers; i++) workers.emplace_back(&Reseeder::worker_loop, this);
+    }
+
+    // pending reseeds left in the queue stay pending, and are done by the generators themselves when needed
+    ~Reseeder() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        for (std::thread &t : workers) t.join();
+    }
+
+    Reseeder(const Reseeder &) = delete;
+    Reseeder &operator=(const Reseeder &) = delete;
+
+    bool enabled() const {
+        return !workers.empty();
+    }
+
+    void submit(const std::vector<PlatformLoadTimeGen *> &gens) {
+        if (gens.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            queue.insert(queue.end(), gens.begin(), gens.end());
+        }
+        work_cv.notify_all();
+    }
+
+    // returns once every submitted reseed is done
+    void drain() {
+        std::unique_lock<std::mutex> lock(m);
+        idle_cv.wait(lock, [&] { return queue.empty() && busy == 0; });
+    }
+};
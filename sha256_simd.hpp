@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include "platform_load_time_gen.hpp"
+
+// multi-buffer SHA-256 for the reseed chains of PlatformLoadTimeGen
+// a single chain is 512 hashes in a row, each one depending on the last, but chains of different platforms have
+// nothing to do with each other. So N chains run in lockstep, lane i of every vector register belonging to chain i:
+// 4 lanes with SSE2, 8 with AVX2 and 16 with AVX-512, picked at runtime from CPUID
+// every hash is of the 8 byte little endian seed, which is one block: the seed, the 0x80 pad byte, zeros, and the
+// bit length 64
+
+namespace sha256_simd {
+
+// N lanes of WORD (the vector_size has to go through a typedef to depend on N)
+template <int N>
+struct vec_type {
+    typedef WORD type __attribute__((vector_size(N * sizeof(WORD))));
+};
+
+template <int N>
+using vec = typename vec_type<N>::type;
+
+// wide vectors can't be passed around by value without an ABI warning for the targets that don't have them, so these
+// are macros rather than functions
+#define VROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define VBSWAP(x) (((x) << 24) | (((x) << 8) & 0x00ff0000) | (((x) >> 8) & 0x0000ff00) | ((x) >> 24))
+
+// runs the reseed loop for N chains. seeds[i] is the combined seed chain i starts from, increments[i] what is added
+// to it before every hash (last_value >> 32, which is below 2^32), and seeds[i] ends up as the final combined seed
+template <int N>
+__attribute__((always_inline)) inline void chains(uint64_t *seeds, const uint64_t *increments) {
+    vec<N> lo, hi, inc;
+    for (int i = 0; i < N; i++) {
+        lo[i] = (WORD)seeds[i];
+        hi[i] = (WORD)(seeds[i] >> 32);
+        inc[i] = (WORD)increments[i];
+    }
+
+    for (int iter = 0; iter < ITER; iter++) {
+        // 64 bit add of an increment below 2^32, a lane that wrapped around carries into the high word
+        vec<N> sum = lo + inc;
+        hi -= (vec<N>)(sum < lo);
+        lo = sum;
+
+        // only words 0 and 1 of the block depend on the seed, the fixed words are folded in at compile time (see
+        // sha256_fixed), and the loops are unrolled so that is_variable is known for every word
+        vec<N> m[64];
+        m[0] = VBSWAP(lo);
+        m[1] = VBSWAP(hi);
+#pragma GCC unroll 64
+        for (int i = 16; i < 64; i++) {
+            vec<N> w = vec<N>{} + sha256_fixed::C[i];
+            if (sha256_fixed::is_variable(i - 2)) w += VROTR(m[i - 2], 17) ^ VROTR(m[i - 2], 19) ^ (m[i - 2] >> 10);
+            if (sha256_fixed::is_variable(i - 7)) w += m[i - 7];
+            if (sha256_fixed::is_variable(i - 15)) w += VROTR(m[i - 15], 7) ^ VROTR(m[i - 15], 18) ^ (m[i - 15] >> 3);
+            if (sha256_fixed::is_variable(i - 16)) w += m[i - 16];
+            m[i] = w;
+        }
+
+        vec<N> a = vec<N>{} + 0x6a09e667, b = vec<N>{} + 0xbb67ae85, c = vec<N>{} + 0x3c6ef372,
+               d = vec<N>{} + 0xa54ff53a, e = vec<N>{} + 0x510e527f, f = vec<N>{} + 0x9b05688c,
+               g = vec<N>{} + 0x1f83d9ab, h = vec<N>{} + 0x5be0cd19;
+#pragma GCC unroll 64
+        for (int i = 0; i < 64; i++) {
+            vec<N> t1 = h + (VROTR(e, 6) ^ VROTR(e, 11) ^ VROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_fixed::KW[i];
+            if (sha256_fixed::is_variable(i)) t1 += m[i];
+            vec<N> t2 = (VROTR(a, 2) ^ VROTR(a, 13) ^ VROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        a += 0x6a09e667;
+        b += 0xbb67ae85;
+        c += 0x3c6ef372;
+        d += 0xa54ff53a;
+        e += 0x510e527f;
+        f += 0x9b05688c;
+        g += 0x1f83d9ab;
+        h += 0x5be0cd19;
+
+        // the hash is the big endian state, read back as four little endian 64 bit words and xored into the seed
+        lo ^= VBSWAP(a ^ c ^ e ^ g);
+        hi ^= VBSWAP(b ^ d ^ f ^ h);
+    }
+
+    for (int i = 0; i < N; i++) seeds[i] = ((uint64_t)hi[i] << 32) | lo[i];
+}
+
+inline void chains_sse2(uint64_t *seeds, const uint64_t *increments) {
+    chains<4>(seeds, increments);
+}
+
+__attribute__((target("avx2"))) inline void chains_avx2(uint64_t *seeds, const uint64_t *increments) {
+    chains<8>(seeds, increments);
+}
+
+__attribute__((target("avx512f"))) inline void chains_avx512(uint64_t *seeds, const uint64_t *increments) {
+    chains<16>(seeds, increments);
+}
+
+#undef VROTR
+#undef VBSWAP
+
+struct Kernel {
+    int lanes;
+    void (*run)(uint64_t *, const uint64_t *);
+};
+
+// widest kernel this CPU can run
+inline Kernel best_kernel() {
+    static const Kernel kernel = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return Kernel{16, chains_avx512};
+        if (__builtin_cpu_supports("avx2")) return Kernel{8, chains_avx2};
+        return Kernel{4, chains_sse2};
+    }();
+    return kernel;
+}
+
+// runs n reseed chains, in groups of the kernel width (the last group is padded with dummy chains)
+// a group with only a few chains costs as much as a full one, so with SHA-NI those few chains run one by one instead
+inline void run_chains(uint64_t *seeds, const uint64_t *increments, size_t n) {
+    Kernel kernel = best_kernel();
+    uint64_t s[16], inc[16];
+    for (size_t begin = 0; begin < n; begin += kernel.lanes) {
+        size_t lanes = std::min<size_t>(kernel.lanes, n - begin);
+        if (lanes * 3 < (size_t)kernel.lanes && sha256_fixed::cpu_has_sha()) {
+            for (size_t i = begin; i < n; i++) seeds[i] = sha256_fixed::chain_shani(seeds[i], increments[i]);
+            break;
+        }
+        for (int i = 0; i < kernel.lanes; i++) {
+            s[i] = i < (int)lanes ? seeds[begin + i] : 0;
+            inc[i] = i < (int)lanes ? increments[begin + i] : 0;
+        }
+        kernel.run(s, inc);
+        for (size_t i = 0; i < lanes; i++) seeds[begin + i] = s[i];
+    }
+}
+
+}  // namespace sha256_simd
+
+// finishes the pending reseeds of n generators together (generators without one, or whose reseed another thread has
+// already taken on, are skipped). The generators end up exactly as if each had reseeded on its own
+inline void reseed_batch(PlatformLoadTimeGen *const *gens, size_t n) {
+    std::vector<uint64_t> seeds, increments;
+    std::vector<PlatformLoadTimeGen *> pending;
+    seeds.reserve(n);
+    increments.reserve(n);
+    pending.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (!gens[i]->try_claim()) continue;
+        pending.push_back(gens[i]);
+        seeds.push_back(gens[i]->pending_seed());
+        increments.push_back(gens[i]->pending_increment());
+    }
+
+    sha256_simd::run_chains(seeds.data(), increments.data(), seeds.size());
+    for (size_t i = 0; i < pending.size(); i++) pending[i]->complete_reseed(seeds[i]);
+}
@@ -3,141 +3,112 @@
 #include <unordered_map>
 #include <iostream>
 #include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cstdio>
 
 #include <mpi.h>
 
 #include "structs.hpp"
 #include "state.hpp"
+#include "packed_state.hpp"
+#include "timing_wheel.hpp"
+#include "platform_clock.hpp"
+#include "exchange.hpp"
+#include "partition.hpp"
+#include "options.hpp"
+#include "thread_pool.hpp"
+#include "sha256_simd.hpp"
+#include "reseeder.hpp"
+#include "topology.hpp"
+#include "network.hpp"
+#include "checkpoint.hpp"
+#include "trace.hpp"
+#include "mpi_io.hpp"
 
 using std::string;
 using std::unordered_map;
 using std::vector;
-using adjacency_matrix = std::vector<std::vector<size_t>>;
 
 
-// create mpi_Train type
-void create_mpi_Train(MPI_Datatype *my_type) {
-    int num_elements = 2;  // Number of elements in the struct
-    int block_lengths[] = {1, 1};  // Number of items of each data type in the struct
-    MPI_Datatype types[] = {MPI_CHAR, MPI_INT};  // Data types of each struct element
-    MPI_Aint offsets[] = {offsetof(Train, line), offsetof(Train, id)};  // Offsets of each struct element
-    MPI_Type_create_struct(num_elements, block_lengths, offsets, types, my_type);
-    MPI_Type_commit(my_type);
-}
-
-// create mpi_State type. You need this to send back states of the train to the master node
-void create_mpi_State(MPI_Datatype *my_type) {
-    int num_elements = 2;  // Number of elements in the struct
-    int block_lengths[] = {1, 5};  // Number of items of each data type in the struct
-    MPI_Datatype types[] = {MPI_CHAR, MPI_INT};  // Data types of each struct element
-    MPI_Aint offsets[] = {offsetof(State, line), offsetof(State, id)};  // Offsets of each struct element
-    MPI_Type_create_struct(num_elements, block_lengths, offsets, types, my_type);
-    MPI_Type_commit(my_type);
-}
+// a train entry costs a reseed, which takes about as long as 100 platform visits (see bench_reseed, bench_platform)
+constexpr long long RESEED_COST = 100;
+
+// per-rank event bookkeeping for the tick loop. Instead of calling send_out on every platform every tick, a platform is
+// only visited when its link or its unloading train is due (the due ticks are known exactly when a train enters, so
+// they go into the platform clock, which is swept once per tick), or when it got a train into its holding area or
+// freed its platform during this tick
+// trains coming from other ranks are announced ahead of time, and wait in their own wheel until their arrival tick
+struct ActivePlatforms {
+    PlatformClock clock;
+    TimingWheel<Arrival> arrival_wheel;
+    int ticks;
+
+    vector<Arrival> arriving;  // trains from other ranks arriving this tick
+    vector<int> due;      // platforms whose link or platform timer expires this tick
+    vector<int> touched;  // platforms that got trains in or freed their platform this tick, they may take a train in
+    vector<int> live;     // platforms that ever had a train, only these can have states to save
+
+    vector<int> touch_stamp;
+    vector<char> is_live;
+
+    // work done per platform since the last rebalance: a visit counts 1, a train entry RESEED_COST
+    vector<long long> cost;
+
+    // per platform results of the parallel phases, indexed like due / touched
+    vector<Train> left;
+    vector<char> changed;
+    vector<PlatformLoadTimeGen*> reseeds;
+
+    ActivePlatforms(const vector<int>& my_platform_ids, int num_platforms, int ticks):
+        clock(my_platform_ids, num_platforms),
+        ticks(ticks),
+        touch_stamp(num_platforms, -1),
+        is_live(num_platforms, 0),
+        cost(num_platforms, 0) {}
+
+    void expect(const Arrival& arrival) {
+        if (arrival.tick < ticks) arrival_wheel.schedule(arrival.tick, arrival);
+    }
 
+    void begin_tick(int tick) {
+        arriving.clear();
+        arrival_wheel.advance(tick, arriving);
 
-// maps each station name to a int
-unordered_map<string, int> station_name_to_id(const vector<string>& station_names) {
-    unordered_map<string, int> out;
-    for (int i = 0; i < station_names.size(); i ++) {
-        out[station_names[i]] = i;
+        due.clear();
+        clock.sweep(tick, due);
+        for (int id : due) cost[id]++;
+        touched.clear();
     }
-    return out;
-}
 
-// count how many platforms, it is just the total degree of the graph
-// degree of each node (or station) = number of outgoing links for that station = number of platforms for that station
-int how_many_platforms(const adjacency_matrix& mat) {
-    int cnt = 0;
-    for (int r = 0; r < mat.size(); r ++) {
-        for (int c = 0; c < mat[0].size(); c ++) {
-            cnt += (mat[r][c] != 0) ? 1 : 0;
+    void touch(int id, int tick) {
+        if (touch_stamp[id] != tick) {
+            touch_stamp[id] = tick;
+            touched.push_back(id);
+            cost[id]++;
         }
+        mark_live(id);
     }
-    return cnt;
-}
-
 
-// a platform is identified by src station id and dest station id
-// creates a hashmap so that we can identify a platform from the src station id and dest station id
-// and also fills the vector<Platforms*> with a new platform with the correct popularity
-// also fills the station name of platform in platform_id_to_string
-unordered_map<int, unordered_map<int, int>> platforms_to_id(const vector<string>& station_names, 
-                                                            const adjacency_matrix& mat, 
-                                                            const unordered_map<string, int>& station_ids,
-                                                            const vector<size_t>& popularities,
-                                                            vector<Platform>& platforms,
-                                                            vector<string>& platform_id_to_string) {
-    int cnt = 0;
-    unordered_map<int, unordered_map<int, int>> out;
-    for (int r = 0; r < mat.size(); r ++) {
-        for (int c = 0; c < mat[0].size(); c ++) {
-            if (mat[r][c] == 0) continue;
-            out[r][c] = cnt;
-
-            // set the src_station_id and dest_station_id, impt when saving states
-            // then set platform (actually station) popularity
-            // then set link distance
-            platforms.emplace_back(r, c, popularities[r], mat[r][c]);
-            platform_id_to_string.push_back(station_names[r]);
-            cnt ++;
+    void mark_live(int id) {
+        if (!is_live[id]) {
+            is_live[id] = 1;
+            live.push_back(id);
         }
     }
-    return out;
-}
+};
 
-// links the platforms for each line
-void link_platforms(char line, const vector<string>& station_line, 
-                    unordered_map<int, unordered_map<int, int>>& platform_ids,
-                    unordered_map<string, int>& station_ids,
-                    vector<Platform>& platforms) {
-    
-    
-    
-    for (int i = 0; i < station_line.size() - 1; i ++) {
-        if (i == 0 && i + 1 == station_line.size() - 1) {
-            int pa_id = platform_ids[station_ids[station_line[0]]][station_ids[station_line[1]]];
-            int pb_id = platform_ids[station_ids[station_line[1]]][station_ids[station_line[0]]];
-            
-            platforms[pa_id].output_platforms[line] = pb_id;
-            platforms[pb_id].input_platforms.push_back(pa_id);
-
-            platforms[pb_id].output_platforms[line] = pa_id;
-            platforms[pa_id].input_platforms.push_back(pb_id);
-        } else if (i == 0) {
-            int pa_id = platform_ids[station_ids[station_line[0]]][station_ids[station_line[1]]];
-            int pb_id = platform_ids[station_ids[station_line[1]]][station_ids[station_line[2]]];
-
-            platforms[pa_id].output_platforms[line] = pb_id;
-            platforms[pb_id].input_platforms.push_back(pa_id);
-
-            int pc_id = platform_ids[station_ids[station_line[1]]][station_ids[station_line[0]]];
-            platforms[pc_id].output_platforms[line] = pa_id;
-            platforms[pa_id].input_platforms.push_back(pc_id);
-        } else if (i + 1 == station_line.size() - 1) {
-            int pa_id = platform_ids[station_ids[station_line[i]]][station_ids[station_line[i + 1]]];
-            int pb_id = platform_ids[station_ids[station_line[i + 1]]][station_ids[station_line[i]]];
-
-            platforms[pa_id].output_platforms[line] = pb_id;
-            platforms[pb_id].input_platforms.push_back(pa_id);
-
-            int pc_id = platform_ids[station_ids[station_line[i]]][station_ids[station_line[i - 1]]];
-            platforms[pb_id].output_platforms[line] = pc_id;
-            platforms[pc_id].input_platforms.push_back(pb_id);
-        } else {
-            int pa_id = platform_ids[station_ids[station_line[i]]][station_ids[station_line[i + 1]]];
-            int pb_id = platform_ids[station_ids[station_line[i + 1]]][station_ids[station_line[i + 2]]];
-            platforms[pa_id].output_platforms[line] = pb_id;
-            platforms[pb_id].input_platforms.push_back(pa_id);
-
-            int pc_id = platform_ids[station_ids[station_line[i + 1]]][station_ids[station_line[i]]];
-            int pd_id = platform_ids[station_ids[station_line[i]]][station_ids[station_line[i - 1]]];
-            platforms[pc_id].output_platforms[line] = pd_id;
-            platforms[pd_id].input_platforms.push_back(pc_id);
-        } 
-    }
+// create mpi_Train type
+void create_mpi_Train(MPI_Datatype *my_type) {
+    int num_elements = 2;  // Number of elements in the struct
+    int block_lengths[] = {1, 1};  // Number of items of each data type in the struct
+    MPI_Datatype types[] = {MPI_CHAR, MPI_INT};  // Data types of each struct element
+    MPI_Aint offsets[] = {offsetof(Train, line), offsetof(Train, id)};  // Offsets of each struct element
+    MPI_Type_create_struct(num_elements, block_lengths, offsets, types, my_type);
+    MPI_Type_commit(my_type);
 }
 
+
 // for each MPI process to know which platforms it has.
 vector<int> assign_platform_ids_to_process(int rank, int total_process, int total_platforms) {
     vector<int> out;
@@ -153,22 +124,46 @@ vector<int> map_platform_to_rank(int total_platforms, int total_process) {
     return out;
 }
 
-// for each line, get the terminal platform ids
-// idx 0 for green line, idx 1 for yellow line, idx 2 for blue line
-vector<vector<int>> get_terminal_platform_ids_for_each_line(const unordered_map<char, vector<string>>& station_lines,
-                                                            unordered_map<int, unordered_map<int, int>>& platform_ids,
-                                                            unordered_map<string, int>& station_ids) {
-    vector<vector<int>> out(3, vector<int>());
-    char lines[] = "gyb";
-    for (int i = 0; i < 3; i ++) {
-        char line = lines[i];
-        const vector<string>& station_line = station_lines.at(line);
-        int start_platform_id = platform_ids[station_ids[station_line[0]]][station_ids[station_line[1]]];
-
-        int len = station_line.size();
-        int end_platform_id = platform_ids[station_ids[station_line[len - 1]]][station_ids[station_line[len - 2]]];
-        out[i].push_back(start_platform_id);
-        out[i].push_back(end_platform_id);
+// line colors in sorted order, so that every rank walks the lines in the same order
+vector<char> sorted_lines(const unordered_map<char, vector<string>>& station_lines) {
+    vector<char> lines;
+    for (const auto& [line, station_line] : station_lines) lines.push_back(line);
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+// platforms of each line in the order a train visits them: out to the last station and back to the first
+vector<vector<int>> get_line_loops(const vector<char>& lines, const unordered_map<char, vector<int>>& line_stations,
+                                   const Topology& topology) {
+    vector<vector<int>> out;
+    for (char line : lines) {
+        const vector<int>& stations = line_stations.at(line);
+        vector<int> loop;
+        for (int i = 0; i + 1 < stations.size(); i ++) {
+            loop.push_back(topology.platform_id(stations[i], stations[i + 1]));
+        }
+        for (int i = stations.size() - 1; i > 0; i --) {
+            loop.push_back(topology.platform_id(stations[i], stations[i - 1]));
+        }
+        out.push_back(loop);
+    }
+    return out;
+}
+
+// expected number of train arrivals at each platform over the run, which is what costs the reseeds
+// a train goes once around its line loop every (sum of travel times + mean unloading times) ticks, and the mean
+// unloading time at a station is its popularity. Every platform gets at least 1, it still costs something to hold
+vector<long long> expected_arrivals(const vector<vector<int>>& line_loops, const vector<size_t>& trains_per_loop,
+                                    const vector<Platform>& platforms, const vector<size_t>& popularities,
+                                    size_t ticks) {
+    vector<long long> out(platforms.size(), 1);
+    for (int i = 0; i < line_loops.size(); i ++) {
+        long long cycle = 0;
+        for (int id : line_loops[i]) cycle += platforms[id].link.travel_time + popularities[platforms[id].src_station_id];
+        if (cycle == 0) continue;
+
+        long long visits = (long long) trains_per_loop[i] * ticks / cycle;
+        for (int id : line_loops[i]) out[id] += visits;
     }
     return out;
 }
@@ -176,16 +171,17 @@ vector<vector<int>> get_terminal_platform_ids_for_each_line(const unordered_map<
 // each MPI process needs to call this process to spawn the train. Should the MPI process have
 // num_trains is changed to a vector, as in simulate, num_trains is a const unordered_map, which means it values 
 // cannot be changed
-// for terminal_platform_ids_for_each_line, idx 0 is for green, idx 1 is for yello, idx 2 is for blue
+// for terminal_platform_ids_for_each_line and num_trains, idx i is for the line colors[i] (0 green, 1 yellow, 2 blue..)
 // eg. terminal_platform_ids_for_each_line[0][1] means the end (or right) terminal platform for the green line
 // if a platform belong to MPI process of rank i, needs to spawn a train, this process will call send_in with Train of
 // the correct color and id
 void spawn_trains(vector<vector<int>>& terminal_platform_ids_for_each_line, vector<int>& platform_which_process,
-                  vector<int>& num_trains, vector<Platform>& platforms, int *count_of_trains_already_spawned, int tick, int rank) {
-    char lines[] = "gyb";
+                  vector<int>& num_trains, vector<Platform>& platforms, ActivePlatforms& active,
+                  int *count_of_trains_already_spawned, int tick, int rank) {
+    TRACE_SCOPE(trace::SPAWN);
 
-    // green, then yellow, then blue
-    for (int i = 0; i < 3; i ++) {
+    // green, then yellow, then blue, and so on in input order
+    for (int i = 0; i < num_trains.size(); i ++) {
         // left terminal then right terminal
         for (int pos = 0; pos <= 1; pos ++) {
             if (num_trains[i] == 0) continue;
@@ -194,7 +190,8 @@ void spawn_trains(vector<vector<int>>& terminal_platform_ids_for_each_line, vect
             
             // if platform belongs to this MPI process
             if (platform_which_process[platform_id] == rank) {
-                platforms[platform_id].send_in({lines[i], *count_of_trains_already_spawned}, tick);
+                platforms[platform_id].send_in({colors[i], *count_of_trains_already_spawned}, tick);
+                active.touch(platform_id, tick);
             }
             (*count_of_trains_already_spawned) ++;
             num_trains[i] --;
@@ -203,176 +200,681 @@ void spawn_trains(vector<vector<int>>& terminal_platform_ids_for_each_line, vect
 }
 
 
-void sendout_sendin_trains(int tick,
-                           vector<int>& my_platform_ids, 
-                           vector<int>& platform_which_process, 
-                           vector<Platform>& platforms, MPI_Datatype mpi_train) {
-    vector<MPI_Request> mpi_requests;
-    
-
-    // this for loop does MPI_Isend for all platforms assign to this rank
-    for (int id : my_platform_ids) {
+// a train that enters a link already knows which platform it goes to and when it gets there. Trains for platforms of
+// other ranks are announced right away, so the receiving rank knows about the arrival at least travel_time ticks
+// ahead, trains for platforms of this rank are handed over when they leave the link
+void sendout_sendin_trains(int tick, vector<Platform>& platforms, ActivePlatforms& active, TrainExchange& exchange,
+                           ThreadPool& pool) {
+    TRACE_SCOPE(trace::SEND_OUT);
+    // only platforms with an expiring link or a finished unloading can change anything in send_out
+    // send_out only touches its own platform, so it runs in parallel, and the results are applied in order after
+    vector<int>& due = active.due;
+    active.left.resize(due.size());
+    active.changed.resize(due.size());
+    pool.parallel_for(due.size(), 64, [&](int i) {
+        Platform& platform = platforms[due[i]];
+        bool had_train = !platform.is_platform_free();
+        active.left[i] = platform.send_out(tick);
+        active.changed[i] = had_train && platform.is_platform_free();
+        active.clock.update(due[i], platform);
+    });
+
+    for (int i = 0; i < due.size(); i ++) {
+        int id = due[i];
         Platform& platform = platforms[id];
-        Train train = platform.send_out(tick);
-        // send out trains, must send to each train in output_platforms, even if no trains to send
-        for (const auto& [line, dest_platform_id] : platform.output_platforms) {
-            MPI_Request request;
-            
-            // even if we send to the same process, it does not matter
-            // i have tested using Isend, Irecv in the same process, and it works
-            // invariant: must send to all output platforms, must recv from all input platforms
-            
-            // IMPT: from tag I must know sender and receiver i.e bijective f:N*N -> N
-            int tag = id * platforms.size() + dest_platform_id;
-            if (!(train == INVALID_TRAIN) && train.line == line) {
-                // send the train
-                MPI_Isend(&train, 1, mpi_train, platform_which_process[dest_platform_id], tag, MPI_COMM_WORLD, &request);
-            } else {
-                // send invalid train
-                MPI_Isend(&INVALID_TRAIN, 1, mpi_train, platform_which_process[dest_platform_id], tag, MPI_COMM_WORLD, &request);
+        Train train = active.left[i];
+
+        // the train moved from the platform into the link, and the platform may take a train from the holding area
+        if (active.changed[i]) {
+            active.touch(id, tick);
+
+            Train entered = platform.link.train.value();
+            int next = platform.output_platforms[entered.line];
+            if (next >= 0 && !exchange.is_local(next)) {
+                int arrival_tick = tick + platform.link.travel_time;
+                if (arrival_tick < active.ticks) exchange.send({next, entered, arrival_tick});
             }
-            
-            mpi_requests.push_back(request);
+        }
+
+        // only real trains are sent, to the output platform of the train's line
+        if (train == INVALID_TRAIN) continue;
+        int next = platform.output_platforms[train.line];
+        if (next >= 0 && exchange.is_local(next)) {
+            platforms[next].send_in(train, tick);
+            active.touch(next, tick);
         }
     }
 
-    vector<vector<Train>> trains_received(my_platform_ids.size(), vector<Train>());
-    
-    // for each platform, receive trains from input_platforms
-    for (int i = 0; i < my_platform_ids.size(); i ++) {
-        int id = my_platform_ids[i];
-        Platform& platform = platforms[id];
-        
-        
-        vector<Train>& recv_buffer = trains_received[i];
-        recv_buffer.resize(platform.input_platforms.size());
+    for (Arrival& arrival : active.arriving) {
+        platforms[arrival.platform_id].send_in(arrival.train, tick);
+        active.touch(arrival.platform_id, tick);
+    }
+}
 
-        for (int j = 0; j < platform.input_platforms.size(); j ++) {
-            
-            MPI_Request request;
-            int input_platform_id = platform.input_platforms[j];
+// the only synchronisation between ranks: swap the trains announced since the last round
+void exchange_announced_trains(ActivePlatforms& active, TrainExchange& exchange) {
+    for (Arrival& arrival : exchange.exchange()) {
+        active.expect(arrival);
+    }
+}
 
-            // IMPT: from tag must know sender and receiver platform
-            int tag = input_platform_id * platforms.size() + id;
-            MPI_Irecv(&(recv_buffer[j]), 1, mpi_train, platform_which_process[input_platform_id], tag, MPI_COMM_WORLD, &request);
+// number of ticks a rank can run without hearing from its neighbours
+// a train announced at tick t arrives at t + travel_time, so as long as ranks swap announcements every w ticks, with w
+// at most the shortest travel time of a link into another rank, every arrival in the next w ticks is already known
+int lookahead_window(const vector<int>& my_platform_ids, const vector<int>& platform_which_process,
+                     const vector<Platform>& platforms, int rank, int ticks, MPI_Comm comm) {
+    int window = std::max(ticks, 1);
+    for (int id : my_platform_ids) {
+        for (int dest_platform_id : platforms[id].output_platforms.next) {
+            if (dest_platform_id < 0) continue;
+            if (platform_which_process[dest_platform_id] != rank) window = std::min(window, platforms[id].link.travel_time);
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &window, 1, MPI_INT, MPI_MIN, comm);
+    return std::max(window, 1);
+}
 
-            mpi_requests.push_back(request);
+// platforms with an input platform on another rank, the only ones trains from other ranks arrive at
+vector<char> boundary_platforms(const vector<int>& my_platform_ids, const vector<int>& platform_which_process,
+                                const vector<Platform>& platforms, int rank) {
+    vector<char> out(platforms.size(), 0);
+    for (int id : my_platform_ids) {
+        for (int input_platform_id : platforms[id].input_platforms) {
+            if (platform_which_process[input_platform_id] != rank) out[id] = 1;
         }
     }
+    return out;
+}
 
-   
-    // now wait all
-    MPI_Waitall(mpi_requests.size(), mpi_requests.data(), MPI_STATUS_IGNORE);
+// only a platform that got a train in or freed its platform this tick can take a train from its holding area
+// each platform has its own generator, so the platforms run in parallel. The reseeds of all trains that entered a
+// platform this tick are then done together, a kernel width of independent chains at a time, either right here or
+// handed to the background reseeder
+void push_train_in_for_my_platforms(int tick, const vector<int>& touched, vector<Platform>& platforms,
+                                    ActivePlatforms& active, ThreadPool& pool, Reseeder& reseeder) {
+    TRACE_SCOPE(trace::PUSH_IN);
+    active.changed.resize(touched.size());
+    pool.parallel_for(touched.size(), 16, [&](int i) {
+        active.changed[i] = platforms[touched[i]].push_train_to_platform(tick);
+    });
+
+    active.reseeds.clear();
+    for (int i = 0; i < touched.size(); i ++) {
+        int id = touched[i];
+        if (!active.changed[i]) continue;
+        active.clock.update(id, platforms[id]);
+        active.reseeds.push_back(&platforms[id].pltg);
+        active.cost[id] += RESEED_COST;
+    }
 
-    for (int i = 0; i < my_platform_ids.size(); i ++) {
-        int id = my_platform_ids[i];
-        platforms[id].send_in(trains_received[i], tick);
+    if (reseeder.enabled()) {
+        reseeder.submit(active.reseeds);
+        return;
     }
+
+    constexpr int batch = 16;
+    vector<PlatformLoadTimeGen*>& reseeds = active.reseeds;
+    pool.parallel_for((reseeds.size() + batch - 1) / batch, 1, [&](int i) {
+        size_t begin = i * batch;
+        reseed_batch(reseeds.data() + begin, std::min<size_t>(batch, reseeds.size() - begin));
+    });
+}
+
+// the train entries of an exchange tick while the round is in flight. Trains from other ranks only arrive at boundary
+// platforms, so the interior platforms take their trains in (and do their reseeds) first, then the round is finished
+// and the boundary platforms go. Arrivals of the round that are due this tick go straight into their holding areas,
+// the rest wait in the arrival wheel
+void overlap_push_train_in(int tick, const vector<char>& boundary, vector<Platform>& platforms, ActivePlatforms& active,
+                           TrainExchange& exchange, ThreadPool& pool, Reseeder& reseeder) {
+    auto deliver = [&](const Arrival& arrival) {
+        if (arrival.tick != tick) {
+            active.expect(arrival);
+            return;
+        }
+        platforms[arrival.platform_id].send_in(arrival.train, tick);
+        active.touch(arrival.platform_id, tick);
+    };
+    exchange.poll(deliver);
+
+    vector<int>& touched = active.touched;
+    auto first_boundary = std::stable_partition(touched.begin(), touched.end(), [&](int id) { return !boundary[id]; });
+    vector<int> interior(touched.begin(), first_boundary);
+    touched.erase(touched.begin(), first_boundary);
+    push_train_in_for_my_platforms(tick, interior, platforms, active, pool, reseeder);
+
+    exchange.finish(deliver);
+    push_train_in_for_my_platforms(tick, touched, platforms, active, pool, reseeder);
+}
+
+void save_platform_states(int tick, vector<Platform>& platforms, ActivePlatforms& active, ThreadPool& pool) {
+    TRACE_SCOPE(trace::SAVE);
+    vector<int>& live = active.live;
+    pool.parallel_for(live.size(), 64, [&](int i) {
+        platforms[live[i]].save_all_states(tick);
+    });
 }
 
-void push_train_in_for_my_platforms(int tick, vector<int>& my_platform_ids, vector<Platform>& platforms) {
+
+void print(vector<int> arr) {
+    for (int x : arr) std::cout << x << " ";
+}
+
+// the states the rank's platforms recorded in ticks [begin, begin + num_ticks), packed and grouped by tick
+PackedTicks pack_states(const vector<int>& my_platform_ids, const vector<Platform>& platforms, int begin,
+                        int num_ticks) {
+    PackedTicks out;
+    out.begin = begin;
+    out.counts.assign(num_ticks, 0);
     for (int id : my_platform_ids) {
-        platforms[id].push_train_to_platform(tick);
+        for (const State& state : platforms[id].saved_states) out.counts[state.tick - begin] ++;
+    }
+    vector<int> next(num_ticks, 0);
+    for (int t = 1; t < num_ticks; t ++) next[t] = next[t - 1] + out.counts[t - 1];
+    out.states.resize(num_ticks > 0 ? next.back() + out.counts.back() : 0);
+    for (int id : my_platform_ids) {
+        for (const State& state : platforms[id].saved_states) {
+            out.states[next[state.tick - begin] ++] = PackedState::pack(state, id);
+        }
+    }
+    return out;
+}
+
+PlatformStations platform_stations(const vector<Platform>& platforms) {
+    PlatformStations stations;
+    for (const Platform& platform : platforms) {
+        stations.src.push_back(platform.src_station_id);
+        stations.dest.push_back(platform.dest_station_id);
+    }
+    return stations;
+}
+
+
+// the distributed output stage: the ticks of the print window are split evenly across the ranks, the states are sent
+// to the rank that owns their tick, and every rank sorts and formats its own ticks and writes them at its offset in
+// the file, which is the total size of the ranks before it. The file ends up the same as what rank 0 would print
+bool write_states_to_file(const PackedTicks& mine, const vector<string>& station_names,
+                          const PlatformStations& stations, const string& path, int rank, int total_processes,
+                          MPI_Comm comm) {
+    int num_ticks = mine.counts.size();
+    auto first_tick_of = [&](int r) { return (int) ((long long) num_ticks * r / total_processes); };
+
+    // the states of the ticks of a rank are one run of mine.states, the counts of those ticks go along with them
+    vector<int> send_counts(total_processes, 0), send_displs(total_processes, 0);
+    vector<int> tick_counts(total_processes), tick_displs(total_processes);
+    for (int r = 0; r < total_processes; r ++) {
+        tick_displs[r] = first_tick_of(r);
+        tick_counts[r] = first_tick_of(r + 1) - first_tick_of(r);
+        for (int t = tick_displs[r]; t < tick_displs[r] + tick_counts[r]; t ++) send_counts[r] += mine.counts[t];
+        if (r > 0) send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+    }
+
+    int first_tick = first_tick_of(rank), my_ticks = first_tick_of(rank + 1) - first_tick;
+    vector<int> recv_counts(total_processes), recv_displs(total_processes, 0);
+    vector<int> recv_tick_counts(total_processes * my_ticks), recv_tick_sizes(total_processes, my_ticks);
+    vector<int> recv_tick_displs(total_processes);
+    for (int r = 0; r < total_processes; r ++) recv_tick_displs[r] = r * my_ticks;
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < total_processes; r ++) recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+    MPI_Alltoallv(mine.counts.data(), tick_counts.data(), tick_displs.data(), MPI_INT, recv_tick_counts.data(),
+                  recv_tick_sizes.data(), recv_tick_displs.data(), MPI_INT, comm);
+    vector<PackedState> recv(recv_displs.back() + recv_counts.back());
+    MPI_Alltoallv(mine.states.data(), send_counts.data(), send_displs.data(), MPI_UINT64_T,
+                  recv.data(), recv_counts.data(), recv_displs.data(), MPI_UINT64_T, comm);
+
+    vector<State> states;
+    states.reserve(recv.size());
+    size_t i = 0;
+    for (int r = 0; r < total_processes; r ++) {
+        for (int t = 0; t < my_ticks; t ++) {
+            int tick = mine.begin + first_tick + t;
+            int n = recv_tick_counts[r * my_ticks + t];
+            for (int k = 0; k < n; k ++) states.push_back(stations.unpack(recv[i ++], tick));
+        }
+    }
+    string out = format_states(states.data(), states.size(), mine.begin + first_tick, my_ticks, station_names);
+
+    long long size = out.size(), offset = 0, total = 0;
+    MPI_Exscan(&size, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) offset = 0;
+    MPI_Allreduce(&size, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        return false;
     }
+    MPI_File_set_size(fh, total);
+
+    mpi_io::in_pieces(offset, offset + size, comm, [&](MPI_Offset from, int count) {
+        MPI_File_write_at_all(fh, from, out.data() + (from - offset), count, MPI_CHAR, MPI_STATUS_IGNORE);
+    });
+    MPI_File_close(&fh);
+    return true;
 }
 
-void save_platform_states(int tick, vector<int>& my_platform_ids, vector<Platform>& platforms) {
+
+// set by SIGUSR1, asks for a checkpoint at the next exchange
+volatile std::sig_atomic_t checkpoint_requested = 0;
+
+void request_checkpoint(int) {
+    checkpoint_requested = 1;
+}
+
+// checkpoints are taken on exchange ticks, every checkpoint_every ticks and when any rank got SIGUSR1, so the ranks
+// have to agree on it
+bool checkpoint_due(int tick, int& next_checkpoint, const SimOptions& options, MPI_Comm comm) {
+    int due = checkpoint_requested || (options.checkpoint_every > 0 && tick >= next_checkpoint);
+    MPI_Allreduce(MPI_IN_PLACE, &due, 1, MPI_INT, MPI_MAX, comm);
+    if (!due) return false;
+
+    checkpoint_requested = 0;
+    if (options.checkpoint_every > 0) next_checkpoint = tick + options.checkpoint_every;
+    return true;
+}
+
+// every rank writes its platforms and pending arrivals to <prefix>.<rank>.tmp, and once all ranks have, the files are
+// renamed over the last checkpoint, so a run that dies while checkpointing still has the previous one
+bool save_checkpoint(const string& prefix, int tick, int ticks, int window, int rank, int total_processes,
+                     const vector<int>& my_platform_ids, vector<Platform>& platforms, ActivePlatforms& active,
+                     Reseeder& reseeder, int count_of_trains_spawned, const vector<int>& num_trains_per_line,
+                     MPI_Comm comm) {
+    TRACE_SCOPE(trace::CHECKPOINT);
+    // the generators are saved settled, so the background reseeds have to be done first
+    reseeder.drain();
+
+    string path = checkpoint_path(prefix, rank);
+    CheckpointWriter w(path + ".tmp");
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.total_processes = total_processes;
+    header.rank = rank;
+    header.tick = tick;
+    header.ticks = ticks;
+    header.window = window;
+    header.count_of_trains_spawned = count_of_trains_spawned;
+    w.put(header);
+    w.put_vector(num_trains_per_line);
+    w.put_vector(my_platform_ids);
+
     for (int id : my_platform_ids) {
-        platforms[id].save_all_states(tick);
+        w.put(active.is_live[id]);
+        write_platform(w, platforms[id]);
     }
+
+    vector<Arrival> arrivals;
+    active.arrival_wheel.pending(arrivals);
+    w.put_vector(arrivals);
+
+    int ok = w.close();
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+    if (ok) ok = std::rename((path + ".tmp").c_str(), path.c_str()) == 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+    return ok;
 }
 
+// loads the rank's checkpoint and rebuilds the platform clock: a train in a link is due when its travel time is up, and
+// a train in a platform when its unloading is done (or later, when its link frees up, but that is the link's time)
+// returns the tick to go on from, or -1 if the checkpoint is missing or was taken by a different run
+int restore_checkpoint(const string& prefix, int ticks, int window, int rank, int total_processes,
+                       const vector<int>& my_platform_ids, vector<Platform>& platforms, ActivePlatforms& active,
+                       int& count_of_trains_spawned, vector<int>& num_trains_per_line, MPI_Comm comm) {
+    CheckpointReader r(checkpoint_path(prefix, rank));
+    CheckpointHeader header = r.get<CheckpointHeader>();
+    vector<int> saved_num_trains = r.get_vector<int>();
+    vector<int> saved_platform_ids = r.get_vector<int>();
+
+    int tick = header.tick;
+    bool ok = r.ok() && std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 &&
+              header.total_processes == total_processes && header.rank == rank && header.ticks == ticks &&
+              header.window == window && saved_platform_ids == my_platform_ids;
+
+    if (ok) {
+        active.arrival_wheel.start_at(tick);
+        for (int id : my_platform_ids) {
+            char live = r.get<char>();
+            Platform& platform = platforms[id];
+            read_platform(r, platform);
+
+            if (live) active.mark_live(id);
+            active.clock.update(id, platform);
+        }
+        for (Arrival& arrival : r.get_vector<Arrival>()) active.expect(arrival);
+        ok = r.ok();
+    }
 
-void print(vector<int> arr) {
-    for (int x : arr) std::cout << x << " ";
+    // all ranks have to go on from the same tick
+    int min_tick = ok ? tick : -1, max_tick = ok ? tick : -1;
+    MPI_Allreduce(MPI_IN_PLACE, &min_tick, 1, MPI_INT, MPI_MIN, comm);
+    MPI_Allreduce(MPI_IN_PLACE, &max_tick, 1, MPI_INT, MPI_MAX, comm);
+    if (min_tick != max_tick || min_tick < 0) return -1;
+
+    count_of_trains_spawned = header.count_of_trains_spawned;
+    num_trains_per_line = saved_num_trains;
+    return tick;
 }
 
-vector<State> collect_all_states(vector<int>& my_platform_ids, vector<Platform>& platforms) {
-    vector<State> out;
+// dynamic rebalancing, on exchange ticks every rebalance_every ticks
+// every rank adds up the measured cost of its platforms (plus one per train waiting in a holding area, and one so no
+// platform weighs nothing). If the busiest rank is more than rebalance_threshold above the average, the line
+// partitioner is run again on the measured weights, and if that is better balanced the platforms that change owner
+// move: their trains, holding areas, timing fields, generators and recorded states are packed up and sent to the new
+// owner with one all-to-all, and every rank updates platform_which_process
+// this runs right after an exchange, so the only trains between ranks are the ones announced to the arrival wheels.
+// Whether a link train is announced depends on whether its destination is on another rank, which the move can change,
+// so the wheels are thrown away and every rank announces its link trains again for the new partition
+// returns true if platforms moved
+bool rebalance(int tick, int ticks, double threshold, const vector<vector<int>>& line_loops,
+               vector<int>& platform_which_process, vector<int>& my_platform_ids, vector<Platform>& platforms,
+               ActivePlatforms& active, TrainExchange& exchange, Reseeder& reseeder, int rank, int total_processes,
+               MPI_Comm comm) {
+    TRACE_SCOPE(trace::REBALANCE);
+
+    vector<long long> weights(platforms.size(), 0);
+    for (int id : my_platform_ids) weights[id] = active.cost[id] + platforms[id].pq.size() + 1;
+    MPI_Allreduce(MPI_IN_PLACE, weights.data(), weights.size(), MPI_LONG_LONG, MPI_SUM, comm);
+    std::fill(active.cost.begin(), active.cost.end(), 0);
+
+    PartitionStats before = evaluate_partition(platforms, platform_which_process, weights, total_processes);
+    if (before.imbalance <= threshold) return false;
+
+    vector<int> owner = line_partition(platforms, line_loops, weights, total_processes);
+    PartitionStats after = evaluate_partition(platforms, owner, weights, total_processes);
+    if (after.imbalance >= before.imbalance) return false;
+
+    // the generators are sent settled
+    reseeder.drain();
+
+    vector<vector<char>> outgoing(total_processes);
+    int moved = 0;
     for (int id : my_platform_ids) {
-        out.insert(out.end(), platforms[id].saved_states.begin(), platforms[id].saved_states.end());
+        if (owner[id] == rank) continue;
+        BufferWriter w(outgoing[owner[id]]);
+        w.put(id);
+        w.put(active.is_live[id]);
+        write_platform(w, platforms[id]);
+
+        // the old copy stays behind empty
+        Platform& platform = platforms[id];
+        platform.link.train.reset();
+        platform.train.reset();
+        platform.pq = vector<Pair>();
+        platform.saved_states = vector<State>();
+        moved ++;
     }
-    return out;
+
+    vector<int> send_counts(total_processes), send_displs(total_processes, 0);
+    vector<char> send;
+    for (int r = 0; r < total_processes; r ++) {
+        send_counts[r] = outgoing[r].size();
+        if (r > 0) send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+        send.insert(send.end(), outgoing[r].begin(), outgoing[r].end());
+    }
+    vector<int> recv_counts(total_processes), recv_displs(total_processes, 0);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < total_processes; r ++) recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+    vector<char> recv(recv_displs.back() + recv_counts.back());
+    MPI_Alltoallv(send.data(), send_counts.data(), send_displs.data(), MPI_BYTE,
+                  recv.data(), recv_counts.data(), recv_displs.data(), MPI_BYTE, comm);
+
+    vector<char> was_live = active.is_live;
+    BufferReader r(recv.data(), recv.data() + recv.size());
+    while (!r.at_end()) {
+        int id = r.get<int>();
+        was_live[id] = r.get<char>();
+        read_platform(r, platforms[id]);
+    }
+
+    platform_which_process = owner;
+    my_platform_ids.clear();
+    for (int id = 0; id < platforms.size(); id ++) {
+        if (owner[id] == rank) my_platform_ids.push_back(id);
+    }
+
+    active = ActivePlatforms(my_platform_ids, platforms.size(), ticks);
+    active.arrival_wheel.start_at(tick);
+    for (int id : my_platform_ids) {
+        if (was_live[id]) active.mark_live(id);
+        active.clock.update(id, platforms[id]);
+    }
+
+    exchange.repartition(my_platform_ids, platforms);
+    for (int id : my_platform_ids) {
+        Platform& platform = platforms[id];
+        if (!platform.link.train.has_value()) continue;
+        int next = platform.output_platforms[platform.link.train->line];
+        int arrival_tick = platform.link.enter_time + platform.link.travel_time;
+        if (next >= 0 && !exchange.is_local(next) && arrival_tick < ticks) {
+            exchange.send({next, platform.link.train.value(), arrival_tick});
+        }
+    }
+    exchange_announced_trains(active, exchange);
+
+    MPI_Allreduce(MPI_IN_PLACE, &moved, 1, MPI_INT, MPI_SUM, comm);
+    if (rank == 0) {
+        std::cerr << "rebalance_tick:" << tick << " imbalance:" << before.imbalance << "->" << after.imbalance
+                  << " moved_platforms:" << moved << std::endl;
+    }
+    return true;
 }
 
+// the default output stage: rank 0 gathers every state, packed, and prints them, or writes them to binary_path
+// returns false if the binary file can't be written
+bool gather_and_print_states(const PackedTicks& mine, size_t ticks, const vector<string>& station_names,
+                             const vector<Platform>& platforms, const string& binary_path, size_t mpi_rank,
+                             size_t total_processes, MPI_Comm comm) {
+    int num_ticks = mine.counts.size();
+    int my_state_size = mine.states.size();
+
+    // the tick counts of every rank, then its states
+    vector<int> counts(mpi_rank == 0 ? total_processes * num_ticks : 0);
+    vector<int> num_states_per_process(total_processes), displacements(total_processes, 0);
+    MPI_Gather(mine.counts.data(), num_ticks, MPI_INT, counts.data(), num_ticks, MPI_INT, 0, comm);
+    MPI_Gather(&my_state_size, 1, MPI_INT, num_states_per_process.data(), 1, MPI_INT, 0, comm);
+    for (int r = 1; r < total_processes; r ++) {
+        displacements[r] = displacements[r - 1] + num_states_per_process[r - 1];
+    }
+    vector<PackedState> all(mpi_rank == 0 ? displacements.back() + num_states_per_process.back() : 0);
+    MPI_Gatherv(mine.states.data(), my_state_size, MPI_UINT64_T, all.data(), num_states_per_process.data(),
+                displacements.data(), MPI_UINT64_T, 0, comm);
+    if (mpi_rank != 0) return true;
+
+    // tick-major over all ranks
+    PackedTicks window;
+    window.begin = mine.begin;
+    window.counts.assign(num_ticks, 0);
+    window.states.resize(all.size());
+    for (int r = 0; r < total_processes; r ++) {
+        for (int t = 0; t < num_ticks; t ++) window.counts[t] += counts[r * num_ticks + t];
+    }
+    vector<int> next(num_ticks, 0);
+    for (int t = 1; t < num_ticks; t ++) next[t] = next[t - 1] + window.counts[t - 1];
+    size_t i = 0;
+    for (int r = 0; r < total_processes; r ++) {
+        for (int t = 0; t < num_ticks; t ++) {
+            int n = counts[r * num_ticks + t];
+            std::copy(all.begin() + i, all.begin() + i + n, window.states.begin() + next[t]);
+            next[t] += n;
+            i += n;
+        }
+    }
+
+    PlatformStations stations = platform_stations(platforms);
+    if (!binary_path.empty()) return state_file::write(binary_path, station_names, stations, window);
 
+    vector<State> states = window.unpack(stations);
+    print_all_states_ptr(states.data(), states.size(), num_ticks, ticks, station_names);
+    return true;
+}
 
 void simulate(size_t num_stations, const vector<string> &station_names, const std::vector<size_t> &popularities,
-              const adjacency_matrix &mat, const unordered_map<char, vector<string>> &station_lines, size_t ticks,
+              const Topology &topology, const unordered_map<char, vector<string>> &station_lines, size_t ticks,
               const unordered_map<char, size_t> num_trains, size_t num_ticks_to_print, size_t mpi_rank,
-              size_t total_processes) {
+              size_t total_processes, MPI_Comm comm, const SimOptions& options) {
     
-    unordered_map<string, int> station_ids = station_name_to_id(station_names);
-    
-    vector<Platform> platforms;
-    vector<string> platform_ids_to_string;
-    unordered_map<int, unordered_map<int, int>> platform_ids = platforms_to_id(station_names, mat, station_ids, popularities, platforms, 
-                                                                               platform_ids_to_string);
+    StationIndex station_index(station_names);
+    unordered_map<char, vector<int>> line_stations = line_station_ids(station_lines, station_index);
+
+    vector<Platform> platforms = make_platforms(topology, popularities);
+
+    // the printed states are packed, every train id and platform has to fit its field
+    size_t total_trains = 0;
+    for (const auto& [line, n] : num_trains) total_trains += n;
+    if (!PackedState::fits(total_trains, platforms.size())) {
+        if (mpi_rank == 0) {
+            std::cerr << "At most " << (1 << PackedState::ID_BITS) << " trains and "
+                      << (1 << PackedState::PLATFORM_BITS) << " platforms are supported, got " << total_trains
+                      << " and " << platforms.size() << std::endl;
+        }
+        MPI_Abort(comm, 2);
+    }
 
-    for (const auto& [color, line] : station_lines) {
-        link_platforms(color, line, platform_ids, station_ids, platforms);
-    } 
+    for (const auto& [color, stations] : line_stations) {
+        link_platforms(color, stations, topology, platforms);
+    }
 
     vector<int> platform_which_process = map_platform_to_rank(platforms.size(), (int) total_processes);
-    
     vector<int> my_platform_ids = assign_platform_ids_to_process(mpi_rank, total_processes, platforms.size());
-    vector<vector<int>> terminal_platform_ids_for_each_line = get_terminal_platform_ids_for_each_line(station_lines, platform_ids, station_ids);
+
+    vector<char> lines = sorted_lines(station_lines);
+    vector<vector<int>> line_loops = get_line_loops(lines, line_stations, topology);
+    if (options.partitioner == Partitioner::LINE || options.report_partition) {
+        vector<size_t> trains_per_loop;
+        for (char line : lines) trains_per_loop.push_back(num_trains.at(line));
+
+        vector<long long> weights = expected_arrivals(line_loops, trains_per_loop, platforms, popularities, ticks);
+
+        if (options.partitioner == Partitioner::LINE) {
+            platform_which_process = line_partition(platforms, line_loops, weights, total_processes);
+            my_platform_ids.clear();
+            for (int id = 0; id < platforms.size(); id ++) {
+                if (platform_which_process[id] == mpi_rank) my_platform_ids.push_back(id);
+            }
+        }
+
+        if (options.report_partition && mpi_rank == 0) {
+            PartitionStats stats = evaluate_partition(platforms, platform_which_process, weights, total_processes);
+            std::cerr << "partition_edge_cut:" << stats.cut_edges << "/" << stats.total_edges
+                      << " partition_imbalance:" << stats.imbalance << std::endl;
+        }
+    }
+    vector<vector<int>> terminal_platform_ids_for_each_line = get_terminal_platform_ids_for_each_line(line_stations, topology);
     
-    vector<int> num_trains_per_line = {(int) num_trains.at('g'), (int) num_trains.at('y'), (int) num_trains.at('b')};
+    vector<int> num_trains_per_line;
+    for (int i = 0; i < station_lines.size(); i ++) num_trains_per_line.push_back(num_trains.at(colors[i]));
     int count_of_trains_spawned = 0;
 
-    MPI_Datatype mpi_train, mpi_state;
-    create_mpi_Train(&mpi_train);
-    create_mpi_State(&mpi_state);
+    ActivePlatforms active(my_platform_ids, platforms.size(), ticks);
+    ThreadPool pool(options.threads);
+    Reseeder reseeder(options.reseed_workers);
+    TrainExchange exchange(my_platform_ids, platform_which_process, platforms, mpi_rank, total_processes, comm,
+                           options.shared_memory);
+
+    // ranks sync every tick, unless running ahead on the lookahead. The window starts over when platforms move
+    int window = 1, window_start = 0;
+    if (options.lookahead) {
+        window = lookahead_window(my_platform_ids, platform_which_process, platforms, mpi_rank, ticks, comm);
+        if (mpi_rank == 0) std::cerr << "lookahead_window:" << window << std::endl;
+    }
 
-    for (int tick = 0; tick < ticks; tick++) {
-        spawn_trains(terminal_platform_ids_for_each_line, platform_which_process, 
-                 num_trains_per_line, platforms, &count_of_trains_spawned, tick, mpi_rank);
+    int start_tick = 0;
+    if (!options.restart_path.empty()) {
+        start_tick = restore_checkpoint(options.restart_path, ticks, window, mpi_rank, total_processes, my_platform_ids,
+                                        platforms, active, count_of_trains_spawned, num_trains_per_line, comm);
+        if (start_tick < 0) {
+            if (mpi_rank == 0) std::cerr << "Cannot restart from " << options.restart_path << std::endl;
+            MPI_Abort(comm, 4);
+        }
+        if (mpi_rank == 0) std::cerr << "restart_tick:" << start_tick << std::endl;
+    }
 
-        sendout_sendin_trains(tick, my_platform_ids, platform_which_process, platforms, mpi_train);
+    int next_checkpoint = start_tick + options.checkpoint_every;
+    int next_rebalance = options.rebalance_every;
+    vector<char> boundary = boundary_platforms(my_platform_ids, platform_which_process, platforms, mpi_rank);
+    if (!options.checkpoint_path.empty()) std::signal(SIGUSR1, request_checkpoint);
+
+#ifndef TRAINS_NO_TRACE
+    if (!options.trace_path.empty()) trace::recorder.start(comm);
+#else
+    if (!options.trace_path.empty() && mpi_rank == 0) std::cerr << "tracing was compiled out" << std::endl;
+#endif
+
+    for (int tick = start_tick; tick < ticks; tick++) {
+        TRACE_TICK(tick);
+
+        bool exchange_tick = (tick - window_start) % window == 0;
+
+        // a checkpoint is taken right after the exchange of its tick, so a restarted run does not redo it
+        // checkpoints and rebalancing need the whole round in, so they are decided before the round starts and on
+        // their ticks the round is not overlapped
+        bool checkpoint_tick = exchange_tick && tick != start_tick && !options.checkpoint_path.empty() &&
+                               checkpoint_due(tick, next_checkpoint, options, comm);
+        bool rebalance_tick = options.rebalance_every > 0 && tick >= next_rebalance;
+        bool overlap = exchange_tick && options.overlap && !checkpoint_tick && !rebalance_tick &&
+                       (tick != start_tick || options.restart_path.empty());
+        if (overlap) {
+            exchange.start();
+        } else if (exchange_tick && (tick != start_tick || options.restart_path.empty())) {
+            exchange_announced_trains(active, exchange);
+        }
 
-        push_train_in_for_my_platforms(tick, my_platform_ids, platforms);
+        if (checkpoint_tick) {
+            if (!save_checkpoint(options.checkpoint_path, tick, ticks, window, mpi_rank, total_processes,
+                                 my_platform_ids, platforms, active, reseeder, count_of_trains_spawned,
+                                 num_trains_per_line, comm)) {
+                if (mpi_rank == 0) std::cerr << "Failed to write checkpoint " << options.checkpoint_path << std::endl;
+            } else if (mpi_rank == 0) {
+                std::cerr << "checkpoint_tick:" << tick << std::endl;
+            }
+        }
 
-        if (tick >= ticks - num_ticks_to_print) save_platform_states(tick, my_platform_ids, platforms);
-        
-    }
+        if (exchange_tick && rebalance_tick) {
+            next_rebalance = tick + options.rebalance_every;
+            if (rebalance(tick, ticks, options.rebalance_threshold, line_loops, platform_which_process,
+                          my_platform_ids, platforms, active, exchange, reseeder, mpi_rank, total_processes, comm)) {
+                boundary = boundary_platforms(my_platform_ids, platform_which_process, platforms, mpi_rank);
+                if (options.lookahead) {
+                    window = lookahead_window(my_platform_ids, platform_which_process, platforms, mpi_rank, ticks,
+                                              comm);
+                    window_start = tick;
+                    if (mpi_rank == 0) std::cerr << "lookahead_window:" << window << std::endl;
+                }
+            }
+        }
 
-    
-    // rank 0 to gather all states
-    vector<State> my_states = collect_all_states(my_platform_ids, platforms);
-    int my_state_size = my_states.size();
+        active.begin_tick(tick);
 
-    // gather num of states
-    int* num_states_per_process = new int[total_processes];
-    MPI_Gather(&my_state_size, 1, MPI_INT, num_states_per_process, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        spawn_trains(terminal_platform_ids_for_each_line, platform_which_process, 
+                 num_trains_per_line, platforms, active, &count_of_trains_spawned, tick, mpi_rank);
 
-    
-    
-    // get total num of states
-    int total_states = 0;
-    if (mpi_rank == 0) {
-        for (int i = 0; i < total_processes; i ++) total_states += num_states_per_process[i];
-    }
-    
+        sendout_sendin_trains(tick, platforms, active, exchange, pool);
 
-    // calculate displacement
-    int* displacements = new int[total_processes];
-    displacements[0] = 0;
-    if (mpi_rank == 0) {
-        for (int i = 1; i < total_processes; i ++) {
-            displacements[i] = displacements[i - 1] + num_states_per_process[i - 1];
+        if (overlap) {
+            overlap_push_train_in(tick, boundary, platforms, active, exchange, pool, reseeder);
+        } else {
+            push_train_in_for_my_platforms(tick, active.touched, platforms, active, pool, reseeder);
         }
+
+        if (tick >= ticks - num_ticks_to_print) save_platform_states(tick, platforms, active, pool);
+        
     }
+
     
-    State* states = new State[total_states];
-    MPI_Gatherv(my_states.data(), my_state_size, mpi_state, states, num_states_per_process, displacements, mpi_state, 0, MPI_COMM_WORLD);
-    
-    if (mpi_rank == 0) {
-        print_all_states_ptr(states, total_states, num_ticks_to_print, ticks, station_names);
+    PackedTicks my_states = pack_states(my_platform_ids, platforms, ticks - num_ticks_to_print, num_ticks_to_print);
+
+    {
+        TRACE_TICK(ticks);
+        TRACE_SCOPE(trace::OUTPUT);
+        if (!options.output_path.empty()) {
+            if (!write_states_to_file(my_states, station_names, platform_stations(platforms), options.output_path,
+                                      mpi_rank, total_processes, comm) && mpi_rank == 0) {
+                std::cerr << "Failed to open " << options.output_path << std::endl;
+            }
+        } else if (!gather_and_print_states(my_states, ticks, station_names, platforms, options.binary_output_path,
+                                            mpi_rank, total_processes, comm)) {
+            std::cerr << "Failed to write " << options.binary_output_path << std::endl;
+        }
     }
 
-    free(num_states_per_process);
-    free(displacements);
-    free(states);
-
-}
\ No newline at end of file
+#ifndef TRAINS_NO_TRACE
+    if (!options.trace_path.empty()) trace::write(options.trace_path, ticks, comm);
+#endif
+}
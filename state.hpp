@@ -3,6 +3,10 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+#include <utility>
 
 
 
@@ -12,7 +16,7 @@
 // if status is 1 or 2, dest_platform_id is irrelevant
 // this is to store the state of the train, when we have to print things out
 
-// to save the state, you need the line which is either 'g', 'y', 'b'
+// to save the state, you need the line, one of the colors in lines.hpp ('g', 'y', 'b', ...)
 // the train id, the src_platform_id, dest_platform_id, the status and the tick
 
 struct State {
@@ -102,40 +106,160 @@ void print_all_states(std::vector<State>& all_states, int num_ticks_to_print, in
     }
 }
 
-void print_all_states_ptr(State* states, int size, int num_ticks_to_print, int ticks, const std::vector<std::string>& station_id_to_string) {
-    std::ios_base::sync_with_stdio(0);
-    std::cin.tie(0);
+// the printed states of a tick are sorted as strings, "<line><id>-<place>", where the place is "<src>-><dest>",
+// "<src>#" or "<src>%". Instead of building and sorting the strings, every state gets integer keys that sort the same
+// way: the line, then the id in decimal string order (a '-' comes before any digit, so a shorter id that is a prefix of
+// a longer one goes first), then the rank of its place string among all the place strings. The places are only
+// rendered once, and the states are written straight into one buffer
+namespace state_format {
+
+// decimal string order of a non-negative id: digit d becomes d + 1 and the positions after the last digit 0, as base 11
+inline uint64_t id_key(int id) {
+    char digits[16];
+    int len = std::to_chars(digits, digits + sizeof(digits), id).ptr - digits;
+    uint64_t key = 0;
+    for (int i = 0; i < 10; i++) key = key * 11 + (i < len ? digits[i] - '0' + 1 : 0);
+    return key;
+}
 
-    std::vector<std::vector<State>> bins(num_ticks_to_print, std::vector<State>());
-    int begin = ticks - num_ticks_to_print;
+inline uint64_t train_key(char line, int id) {
+    return ((uint64_t)(unsigned char)line << 40) | id_key(id);
+}
 
-    for (int i = 0; i < size; i ++) {
-        State& state = states[i];
-        bins[state.tick - begin].push_back(state);
+struct Entry {
+    uint64_t train;
+    uint32_t place_rank;
+    uint32_t place;
+    int id;
+
+    bool operator<(const Entry &other) const {
+        return train != other.train ? train < other.train : place_rank < other.place_rank;
     }
+};
 
-    for (int i = begin; i < ticks; i ++) {
-        std::vector<State>& state_at_tick = bins[i - begin];
+// every place the states can be in: "<station>#" and "<station>%" for each station, and "<src>-><dest>" for every
+// link some train is recorded on. The strings live in one pool, and rank is their sorted position
+class Places {
+  private:
+    size_t num_stations;
+    std::vector<uint64_t> links;  // (src << 32 | dest) of the recorded links, sorted
+    std::string pool;
+    std::vector<size_t> begin;
+    std::vector<uint32_t> rank;
+
+    void add(std::string_view name, std::string_view suffix, std::string_view dest = "") {
+        pool.append(name);
+        pool.append(suffix);
+        pool.append(dest);
+        begin.push_back(pool.size());
+    }
 
-        // collect all the string results
-        std::vector<std::string> store;
-        for (State& state : state_at_tick) {
-            store.push_back(state_to_string(state, station_id_to_string));
+    static std::vector<uint64_t> recorded_links(const State *states, int size) {
+        std::vector<uint64_t> out;
+        for (int i = 0; i < size; i++) {
+            if (states[i].status == 0)
+                out.push_back((uint64_t)states[i].src_platform_id << 32 | (uint32_t)states[i].dest_platform_id);
         }
+        return out;
+    }
 
-        // sort them in lexicographical order
-        std::sort(store.begin(), store.end());
-        std::cout << i << ":";
-        for (std::string& str :store) {
-            std::cout << " " << str;
+  public:
+    Places(const State *states, int size, const std::vector<std::string> &station_id_to_string)
+        : Places(recorded_links(states, size), station_id_to_string) {}
+
+    // the places of the given links, (src << 32 | dest) each in any order, for formatting many batches of states with
+    // one table. Every state in transit has to be on one of them
+    Places(std::vector<uint64_t> all_links, const std::vector<std::string> &station_id_to_string)
+        : num_stations(station_id_to_string.size()), links(std::move(all_links)) {
+        std::sort(links.begin(), links.end());
+        links.erase(std::unique(links.begin(), links.end()), links.end());
+
+        begin.push_back(0);
+        for (const std::string &name : station_id_to_string) {
+            add(name, "#");
+            add(name, "%");
         }
-        std::cout << '\n';
+        for (uint64_t link : links) add(station_id_to_string[link >> 32], "->", station_id_to_string[(uint32_t)link]);
+
+        std::vector<uint32_t> order(begin.size() - 1);
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return str(a) < str(b); });
+        rank.resize(order.size());
+        for (uint32_t i = 0; i < order.size(); i++) rank[order[i]] = i;
     }
 
-}
+    std::string_view str(uint32_t place) const {
+        return std::string_view(pool.data() + begin[place], begin[place + 1] - begin[place]);
+    }
 
+    uint32_t of(const State &state) const {
+        if (state.status == 1) return 2 * state.src_platform_id;
+        if (state.status == 2) return 2 * state.src_platform_id + 1;
+        uint64_t link = (uint64_t)state.src_platform_id << 32 | (uint32_t)state.dest_platform_id;
+        return 2 * num_stations + (std::lower_bound(links.begin(), links.end(), link) - links.begin());
+    }
 
+    uint32_t rank_of(uint32_t place) const {
+        return rank[place];
+    }
+};
 
+}  // namespace state_format
 
+// the printed lines of ticks [begin, begin + num_ticks), every state has to be in that range
+std::string format_states(const State* states, int size, int begin, int num_ticks, const state_format::Places& places) {
+    using namespace state_format;
 
+    // bin the states by tick, then sort each bin on its keys
+    std::vector<int> bin_begin(num_ticks + 1, 0);
+    for (int i = 0; i < size; i ++) bin_begin[states[i].tick - begin + 1]++;
+    for (int t = 0; t < num_ticks; t ++) bin_begin[t + 1] += bin_begin[t];
 
+    // the whole output is rendered into one buffer: a state takes at most ' ', the line, 11 digits, '-' and its place,
+    // and a tick at most 11 digits, ':' and '\n'
+    std::vector<Entry> entries(size);
+    std::vector<int> next(bin_begin.begin(), bin_begin.end() - 1);
+    size_t out_size = 0;
+    for (int i = 0; i < size; i ++) {
+        const State& state = states[i];
+        uint32_t place = places.of(state);
+        entries[next[state.tick - begin]++] = {train_key(state.line, state.id), places.rank_of(place), place, state.id};
+        out_size += 14 + places.str(place).size();
+    }
+    for (int t = 0; t < num_ticks; t ++) {
+        std::sort(entries.begin() + bin_begin[t], entries.begin() + bin_begin[t + 1]);
+    }
+    out_size += (size_t)num_ticks * 13;
+
+    std::string out(out_size, '\0');
+    char* p = out.data();
+    for (int t = 0; t < num_ticks; t ++) {
+        p = std::to_chars(p, p + 11, begin + t).ptr;
+        *p++ = ':';
+        for (int i = bin_begin[t]; i < bin_begin[t + 1]; i ++) {
+            const Entry& entry = entries[i];
+            *p++ = ' ';
+            *p++ = (char)(entry.train >> 40);
+            p = std::to_chars(p, p + 11, entry.id).ptr;
+            *p++ = '-';
+            std::string_view place = places.str(entry.place);
+            p = std::copy(place.begin(), place.end(), p);
+        }
+        *p++ = '\n';
+    }
+    out.resize(p - out.data());
+    return out;
+}
+
+std::string format_states(const State* states, int size, int begin, int num_ticks,
+                          const std::vector<std::string>& station_id_to_string) {
+    return format_states(states, size, begin, num_ticks, state_format::Places(states, size, station_id_to_string));
+}
+
+void print_all_states_ptr(State* states, int size, int num_ticks_to_print, int ticks, const std::vector<std::string>& station_id_to_string) {
+    std::ios_base::sync_with_stdio(0);
+    std::cin.tie(0);
+
+    std::string out = format_states(states, size, ticks - num_ticks_to_print, num_ticks_to_print, station_id_to_string);
+    std::cout.write(out.data(), out.size());
+}
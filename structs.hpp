@@ -1,3 +1,4 @@
+#pragma once
 #include <unordered_map>
 #include <queue>
 #include <vector>
@@ -6,6 +7,7 @@
 
 #include "platform_load_time_gen.hpp"
 #include "state.hpp"
+#include "lines.hpp"
 
 using std::make_heap;
 using std::push_heap;
@@ -67,20 +69,22 @@ struct Link {
 
 
 
-struct Platform {
+// the fields send_out and push_train_to_platform read every visit come first and share one cache line, the
+// generator (a few KB) comes last
+struct alignas(64) Platform {
     int src_station_id, dest_station_id;
-    PlatformLoadTimeGen pltg;
-    std::unordered_map<char, int> output_platforms;
-    std::vector<int> input_platforms;
-
-    std::vector<Pair> pq;
-    std::vector<State> saved_states;
-
     Link link;
     std::optional<Train> train;
     int unloading_time = 0;
     int enter_time = 0;
 
+    std::vector<Pair> pq;
+    std::vector<State> saved_states;
+
+    LineRoutes output_platforms;
+    std::vector<int> input_platforms;
+    PlatformLoadTimeGen pltg;
+
     //Platform(): pltg(1) {}
 
     //Platform(int popularity): pltg(popularity) {}
@@ -90,8 +94,8 @@ struct Platform {
     Platform(int src_station_id, int dest_station_id, int popularity, int link_travel_time): 
         src_station_id(src_station_id), 
         dest_station_id(dest_station_id), 
-        pltg(popularity),
-        link(link_travel_time) {}
+        link(link_travel_time),
+        pltg(popularity) {}
     
     bool is_platform_free() {
         return !train.has_value();
@@ -107,9 +111,11 @@ struct Platform {
         return out;
     }
 
+    // the reseed is left pending, so the caller can batch it with other platforms (reseed_batch), it is done at the
+    // next train_enter otherwise
     void train_enter(Train train, int tick) {
         this->train = train;
-        unloading_time = pltg.next(train.id);
+        unloading_time = pltg.next_deferred(train.id);
         enter_time = tick;
     }
 
@@ -156,12 +162,15 @@ struct Platform {
         push_heap(pq.begin(), pq.end(), compare);
     }
 
-    void push_train_to_platform(int tick) {
+    // returns true if a train entered the platform
+    bool push_train_to_platform(int tick) {
         if (!pq.empty() && is_platform_free()) {
             pop_heap(pq.begin(), pq.end(), compare);
             train_enter(pq.back().train, tick);
             pq.pop_back();
+            return true;
         }
+        return false;
     }
 
     void save_train_in_link_state(int tick) {
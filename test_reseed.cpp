@@ -0,0 +1,147 @@
+#include "platform_load_time_gen.hpp"
+#include "sha256_simd.hpp"
+#include "reseeder.hpp"
+#include <bits/stdc++.h>
+using namespace std;
+
+// what the hash of one seed folds to with the original sha256_* functions
+uint64_t reference_hash(uint64_t seed) {
+    SHA256_CTX ctx;
+    std::array<BYTE, 32> hash;
+    std::array<BYTE, sizeof(seed)> byte_arr;
+    std::memcpy(byte_arr.data(), &seed, sizeof(seed));
+    sha256_init(ctx);
+    sha256_update(ctx, byte_arr.data(), sizeof(byte_arr));
+    sha256_final(ctx, hash);
+
+    uint64_t out = 0;
+    for (short j = 0; j < 32; j += 8) out ^= *(uint64_t *)(&hash[j]);
+    return out;
+}
+
+uint64_t reference_chain(uint64_t seed, uint64_t increment) {
+    for (short it = 0; it < ITER; it++) {
+        seed = seed + increment;
+        seed ^= reference_hash(seed);
+    }
+    return seed;
+}
+
+// the batched reseed must leave every generator exactly where the scalar reseed leaves it
+void test1() {
+    for (int n : {1, 3, 4, 7, 8, 16, 17, 40}) {
+        vector<PlatformLoadTimeGen> scalar, batched;
+        for (int i = 0; i < n; i++) {
+            scalar.emplace_back(1 + i % 9);
+            batched.emplace_back(1 + i % 9);
+        }
+
+        for (int round = 0; round < 20; round++) {
+            vector<PlatformLoadTimeGen *> gens;
+            for (int i = 0; i < n; i++) {
+                int train_id = round * 1000 + i * 37;
+                int a = scalar[i].next(train_id);
+                int b = batched[i].next_deferred(train_id);
+                if (a != b) throw runtime_error("waiting time differs, n=" + to_string(n));
+                gens.push_back(&batched[i]);
+            }
+            // leave some generators pending, they must settle on their own at the next draw
+            if (round % 3 != 2) reseed_batch(gens.data(), gens.size());
+        }
+    }
+}
+
+// every kernel width against the scalar chain, including seeds whose low word wraps around
+void test2() {
+    mt19937_64 rng(42);
+    vector<uint64_t> seeds(16), increments(16), expected(16);
+    for (int trial = 0; trial < 200; trial++) {
+        for (int i = 0; i < 16; i++) {
+            seeds[i] = rng();
+            increments[i] = rng() >> 32;
+            if (i == 0) seeds[i] |= 0xffffffffULL;
+        }
+
+        for (int i = 0; i < 16; i++) expected[i] = reference_chain(seeds[i], increments[i]);
+
+        vector<uint64_t> got = seeds;
+        sha256_simd::chains_sse2(got.data(), increments.data());
+        for (int i = 0; i < 4; i++) {
+            if (got[i] != expected[i]) throw runtime_error("sse2 lane " + to_string(i));
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            got = seeds;
+            sha256_simd::chains_avx2(got.data(), increments.data());
+            for (int i = 0; i < 8; i++) {
+                if (got[i] != expected[i]) throw runtime_error("avx2 lane " + to_string(i));
+            }
+        }
+        if (__builtin_cpu_supports("avx512f")) {
+            got = seeds;
+            sha256_simd::chains_avx512(got.data(), increments.data());
+            for (int i = 0; i < 16; i++) {
+                if (got[i] != expected[i]) throw runtime_error("avx512 lane " + to_string(i));
+            }
+        }
+    }
+}
+
+// the fixed-length fast path against sha256_init/update/final, over a few million seeds: a dense run of small seeds,
+// seeds around every byte boundary, and random ones
+void test3() {
+    vector<uint64_t> seeds;
+    for (uint64_t s = 0; s < 1000000; s++) seeds.push_back(s);
+    for (int bit = 0; bit < 64; bit++) {
+        for (int d = -2; d <= 2; d++) seeds.push_back((1ULL << bit) + d);
+    }
+    mt19937_64 rng(7);
+    for (int i = 0; i < 2000000; i++) seeds.push_back(rng());
+
+    bool has_sha = sha256_fixed::cpu_has_sha();
+    for (uint64_t seed : seeds) {
+        uint64_t expected = reference_hash(seed);
+        if (sha256_fixed::hash_portable(seed) != expected) throw runtime_error("portable seed " + to_string(seed));
+        if (has_sha && sha256_fixed::hash_shani(seed) != expected) throw runtime_error("sha-ni seed " + to_string(seed));
+    }
+
+    for (int i = 0; i < 100; i++) {
+        uint64_t seed = rng(), increment = rng() >> 32;
+        uint64_t expected = reference_chain(seed, increment);
+        if (sha256_fixed::chain_portable(seed, increment) != expected) throw runtime_error("portable chain");
+        if (has_sha && sha256_fixed::chain_shani(seed, increment) != expected) throw runtime_error("sha-ni chain");
+    }
+}
+
+// reseeds handed to background workers, with the generators drawn again while some are still queued or running
+void test4() {
+    int n = 64;
+    vector<PlatformLoadTimeGen> scalar, deferred;
+    for (int i = 0; i < n; i++) {
+        scalar.emplace_back(1 + i % 5);
+        deferred.emplace_back(1 + i % 5);
+    }
+
+    Reseeder reseeder(3);
+    for (int round = 0; round < 10; round++) {
+        vector<PlatformLoadTimeGen *> gens;
+        for (int i = 0; i < n; i++) {
+            int a = scalar[i].next(round * n + i);
+            int b = deferred[i].next_deferred(round * n + i);
+            if (a != b) throw runtime_error("deferred waiting time differs, round " + to_string(round));
+            gens.push_back(&deferred[i]);
+        }
+        reseeder.submit(gens);
+    }
+    reseeder.drain();
+    for (int i = 0; i < n; i++) {
+        if (scalar[i].next(7) != deferred[i].next_deferred(7)) throw runtime_error("deferred generator differs");
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    cout << "test_reseed passed" << endl;
+}
@@ -1,4 +1,5 @@
 #include "state.hpp"
+#include "lines.hpp"
 #include <bits/stdc++.h>
 using namespace std;
 
@@ -46,10 +47,40 @@ void test5() {
     print_all_states_ptr(states, 5, 3, 3, station_ids_to_string);
 }
 
+// format_states sorts on integer keys instead of strings, it has to print exactly what print_all_states prints:
+// station names that are prefixes of each other, ids across digit counts, all three statuses and every line color
+void test6() {
+    // print_all_states turns off stdio sync, which swaps cout's buffer, so that has to happen before capturing it
+    ios_base::sync_with_stdio(0);
+    mt19937 rng(7);
+    vector<string> names = {"a", "ab", "abc", "b", "ba", "bab", "aa", "z", "zz", "ca"};
+    vector<int> ids = {0, 1, 2, 9, 10, 11, 19, 99, 100, 101, 109, 999, 1000, 1001, 12345, 123456789};
+    for (int trial = 0; trial < 500; trial++) {
+        int num_ticks = 1 + rng() % 5, begin = rng() % 3 == 0 ? 0 : rng() % 100000, size = rng() % 60;
+        vector<State> states;
+        for (int i = 0; i < size; i++) {
+            char line = colors[rng() % MAX_LINES];
+            int id = rng() % 2 ? ids[rng() % ids.size()] : (int)(rng() % 2000);
+            int src = rng() % names.size(), dest = (src + 1 + rng() % (names.size() - 1)) % names.size();
+            states.push_back({line, id, src, dest, (int)(rng() % 3), begin + (int)(rng() % num_ticks)});
+        }
+
+        ostringstream expected;
+        streambuf *old = cout.rdbuf(expected.rdbuf());
+        print_all_states(states, num_ticks, begin + num_ticks, names);
+        cout.rdbuf(old);
+
+        string got = format_states(states.data(), states.size(), begin, num_ticks, names);
+        if (got != expected.str()) throw runtime_error("format_states differs in trial " + to_string(trial) + ":\n" +
+                                                       got + "expected:\n" + expected.str());
+    }
+}
+
 int main() {
     //test1();
     //test2();
     //test3();
     //test4();
     test5();
+    test6();
 }
\ No newline at end of file
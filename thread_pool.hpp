@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+// work-stealing thread pool for the per-platform work of a rank
+// parallel_for cuts [0, n) into chunks and deals them out to one deque per thread. A thread works through its own
+// deque from the front, and once it runs dry it steals from the back of the others, so a chunk full of reseeds does
+// not hold up the rest. The calling thread is thread 0 and does its share too, and it is the only thread that should
+// call MPI (MPI_THREAD_FUNNELED)
+class ThreadPool {
+  private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::pair<int, int>> ranges;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::function<void(int)> body;
+    std::atomic<int> pending{0};  // chunks of the current parallel_for not finished yet
+
+    std::mutex m;
+    std::condition_variable cv;
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    bool pop(int self, std::pair<int, int> &range) {
+        for (int k = 0; k < queues.size(); k++) {
+            Queue &q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.ranges.empty()) continue;
+            if (k == 0) {
+                range = q.ranges.front();
+                q.ranges.pop_front();
+            } else {
+                range = q.ranges.back();
+                q.ranges.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void run_chunks(int self) {
+        std::pair<int, int> range;
+        while (pop(self, range)) {
+            for (int i = range.first; i < range.second; i++) body(i);
+            pending.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void worker_loop(int self) {
+        unsigned long long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            run_chunks(self);
+        }
+    }
+
+  public:
+    // num_threads includes the calling thread, so 1 means everything runs inline
+    explicit ThreadPool(int num_threads) {
+        if (num_threads < 1) num_threads = 1;
+        for (int i = 0; i < num_threads; i++) queues.push_back(std::make_unique<Queue>());
+        for (int i = 1; i < num_threads; i++) workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (std::thread &t : workers) t.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const {
+        return queues.size();
+    }
+
+    // calls fn(i) for every i in [0, n), in chunks of grain, and returns once all calls are done
+    // calls for different i can run at the same time, so fn(i) must only touch data that belongs to i
+    template <typename F>
+    void parallel_for(int n, int grain, F &&fn) {
+        if (grain < 1) grain = 1;
+        if (workers.empty() || n <= grain) {
+            for (int i = 0; i < n; i++) fn(i);
+            return;
+        }
+
+        body = std::forward<F>(fn);
+        pending.store((n + grain - 1) / grain, std::memory_order_relaxed);
+        for (int begin = 0, chunk = 0; begin < n; begin += grain, chunk++) {
+            Queue &q = *queues[chunk % queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            q.ranges.push_back({begin, std::min(n, begin + grain)});
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+            generation++;
+        }
+        cv.notify_all();
+
+        run_chunks(0);
+        while (pending.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+    }
+};
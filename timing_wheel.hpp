@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <utility>
+
+// hierarchical timing wheel (calendar queue) keyed on tick
+// level 0 has one slot per tick, level l has one slot per 2^(8 * l) ticks. An entry far in the future sits in a
+// coarse level and is cascaded into the finer levels as the wheel turns, so schedule and advance are O(1) amortised
+// and an idle tick costs nothing, no matter how many entries are in the wheel
+template <typename T>
+class TimingWheel {
+  private:
+    static constexpr int LEVELS = 4;
+    static constexpr int BITS = 8;
+    static constexpr int SLOTS = 1 << BITS;
+    static constexpr int MASK = SLOTS - 1;
+
+    // each entry is (due tick, value)
+    std::vector<std::pair<int, T>> slots[LEVELS][SLOTS];
+    int now = 0;
+
+    void insert(int tick, const T &value) {
+        int level = 0;
+        while (level < LEVELS - 1 && (tick >> (BITS * (level + 1))) != (now >> (BITS * (level + 1)))) level++;
+        slots[level][(tick >> (BITS * level)) & MASK].push_back({tick, value});
+    }
+
+    void cascade(int level) {
+        std::vector<std::pair<int, T>> entries;
+        entries.swap(slots[level][(now >> (BITS * level)) & MASK]);
+        for (auto &[tick, value] : entries) insert(tick, value);
+    }
+
+  public:
+    // tick must be later than the tick last passed to advance (any tick is fine before the first advance)
+    void schedule(int tick, const T &value) {
+        insert(tick, value);
+    }
+
+    // a wheel that starts at a later tick than 0 (restored from a checkpoint) must be told so before anything is
+    // scheduled, advance then starts from that tick
+    void start_at(int tick) {
+        now = tick;
+    }
+
+    // every value still in the wheel
+    void pending(std::vector<T> &out) const {
+        for (int level = 0; level < LEVELS; level++) {
+            for (const auto &slot : slots[level]) {
+                for (const auto &[due, value] : slot) out.push_back(value);
+            }
+        }
+    }
+
+    // moves every value due at tick into out (a value scheduled twice for the same tick comes out twice)
+    // advance must be called once for every tick, in increasing order, starting from 0 (or the start_at tick)
+    void advance(int tick, std::vector<T> &out) {
+        now = tick;
+
+        // when a coarse slot boundary is crossed, spread that slot into the finer levels, coarsest level first
+        for (int level = LEVELS - 1; level > 0; level--) {
+            if ((now & ((1 << (BITS * level)) - 1)) == 0) cascade(level);
+        }
+
+        std::vector<std::pair<int, T>> &slot = slots[0][now & MASK];
+        for (auto &[due, value] : slot) out.push_back(value);
+        slot.clear();
+    }
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cstddef>
+
+// sparse station graph in CSR form: the links out of station s are [row_begin[s], row_begin[s + 1]), sorted by
+// destination. Every link is one platform (the platform at its source station), and the platform id is the link's
+// offset in the CSR arrays, which is the row-major order of the nonzeros of the adjacency matrix
+class Topology {
+  private:
+    std::vector<int> row_begin;
+    std::vector<int> dest;
+    std::vector<int> travel_time;
+
+  public:
+    explicit Topology(size_t num_stations) : row_begin(num_stations + 1, 0) {}
+
+    // links have to be added in row-major order (by source, then by destination), and finish() called after the last
+    void add_link(int src, int dst, int time) {
+        row_begin[src + 1]++;
+        dest.push_back(dst);
+        travel_time.push_back(time);
+    }
+
+    void finish() {
+        for (size_t s = 1; s < row_begin.size(); s++) row_begin[s] += row_begin[s - 1];
+    }
+
+    size_t num_stations() const {
+        return row_begin.size() - 1;
+    }
+
+    size_t num_links() const {
+        return dest.size();
+    }
+
+    int links_begin(int src) const {
+        return row_begin[src];
+    }
+
+    int links_end(int src) const {
+        return row_begin[src + 1];
+    }
+
+    int link_dest(int link) const {
+        return dest[link];
+    }
+
+    int link_travel_time(int link) const {
+        return travel_time[link];
+    }
+
+    // platform id of the link src -> dst, -1 if there is no such link
+    int platform_id(int src, int dst) const {
+        auto first = dest.begin() + row_begin[src], last = dest.begin() + row_begin[src + 1];
+        auto it = std::lower_bound(first, last, dst);
+        return (it != last && *it == dst) ? it - dest.begin() : -1;
+    }
+};
+
+// station name -> station id, by binary search over the names sorted once
+class StationIndex {
+  private:
+    const std::vector<std::string> &names;
+    std::vector<int> order;
+
+  public:
+    explicit StationIndex(const std::vector<std::string> &names) : names(names), order(names.size()) {
+        for (int i = 0; i < order.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return names[a] < names[b]; });
+    }
+
+    // -1 for a name that is not a station
+    int id(std::string_view name) const {
+        auto it = std::lower_bound(order.begin(), order.end(), name,
+                                   [&](int i, std::string_view n) { return std::string_view(names[i]) < n; });
+        return (it != order.end() && names[*it] == name) ? *it : -1;
+    }
+
+    std::vector<int> ids(const std::vector<std::string> &station_line) const {
+        std::vector<int> out;
+        out.reserve(station_line.size());
+        for (const std::string &name : station_line) out.push_back(id(name));
+        return out;
+    }
+};
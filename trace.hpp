@@ -0,0 +1,173 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+
+#include <mpi.h>
+
+// per-rank phase tracing
+// every rank records how long each phase of each tick took. At the end everything is gathered on rank 0, which writes
+// a Chrome trace (chrome://tracing or ui.perfetto.dev, one process per rank) and prints a summary to stderr: the
+// per-rank total of every phase, and for every tick which rank was busiest (waiting in MPI_Waitall does not count)
+// and how far above the average it was
+// tracing is off unless --trace=FILE is given, then a phase costs two MPI_Wtime calls. With -DTRAINS_NO_TRACE the
+// TRACE_ macros compile to nothing
+namespace trace {
+
+enum Phase { POST, WAITALL, SPAWN, SEND_OUT, PUSH_IN, SAVE, CHECKPOINT, REBALANCE, OUTPUT, NUM_PHASES };
+
+constexpr const char *PHASE_NAMES[NUM_PHASES] = {"post_isend_irecv", "waitall",     "spawn_trains", "send_out",
+                                                 "push_train_in",    "save_states", "checkpoint",   "rebalance",
+                                                 "gather_print"};
+
+struct Event {
+    int phase;
+    int tick;
+    double start, end;  // seconds since the rank started tracing
+};
+
+class Recorder {
+  private:
+    bool on = false;
+    int tick = -1;
+    double origin = 0;
+    std::vector<Event> events;
+
+  public:
+    bool enabled() const {
+        return on;
+    }
+
+    // collective, so that the ranks start their clocks together
+    void start(MPI_Comm comm) {
+        MPI_Barrier(comm);
+        origin = MPI_Wtime();
+        on = true;
+    }
+
+    void set_tick(int t) {
+        tick = t;
+    }
+
+    void record(Phase phase, double start, double end) {
+        events.push_back({phase, tick, start - origin, end - origin});
+    }
+
+    const std::vector<Event> &recorded() const {
+        return events;
+    }
+};
+
+inline Recorder recorder;
+
+// times the enclosing block as one phase of the current tick
+class Scope {
+  private:
+    Phase phase;
+    double start = 0;
+
+  public:
+    explicit Scope(Phase phase) : phase(phase) {
+        if (recorder.enabled()) start = MPI_Wtime();
+    }
+
+    ~Scope() {
+        if (recorder.enabled()) recorder.record(phase, start, MPI_Wtime());
+    }
+};
+
+// per-rank phase totals, and per tick the busiest rank and max / mean busy time
+inline void print_summary(const std::vector<std::vector<Event>> &per_rank, int ticks) {
+    int size = per_rank.size();
+    std::vector<std::vector<double>> totals(size, std::vector<double>(NUM_PHASES, 0));
+    std::vector<std::vector<double>> busy(ticks, std::vector<double>(size, 0));
+    for (int r = 0; r < size; r++) {
+        for (const Event &e : per_rank[r]) {
+            totals[r][e.phase] += e.end - e.start;
+            if (e.phase != WAITALL && e.tick >= 0 && e.tick < ticks) busy[e.tick][r] += e.end - e.start;
+        }
+    }
+
+    std::vector<int> straggler_ticks(size, 0);
+    double imbalance_sum = 0, imbalance_max = 0;
+    int busy_ticks = 0;
+    for (int t = 0; t < ticks; t++) {
+        double sum = 0;
+        for (double b : busy[t]) sum += b;
+        if (sum <= 0) continue;
+        int slowest = std::max_element(busy[t].begin(), busy[t].end()) - busy[t].begin();
+        double imbalance = busy[t][slowest] / (sum / size);
+        straggler_ticks[slowest]++;
+        imbalance_sum += imbalance;
+        imbalance_max = std::max(imbalance_max, imbalance);
+        busy_ticks++;
+    }
+
+    std::fprintf(stderr, "trace summary (seconds)\n%-6s", "rank");
+    for (int p = 0; p < NUM_PHASES; p++) std::fprintf(stderr, " %16s", PHASE_NAMES[p]);
+    std::fprintf(stderr, " %16s\n", "straggler_ticks");
+    for (int r = 0; r < size; r++) {
+        std::fprintf(stderr, "%-6d", r);
+        for (int p = 0; p < NUM_PHASES; p++) std::fprintf(stderr, " %16.6f", totals[r][p]);
+        std::fprintf(stderr, " %16d\n", straggler_ticks[r]);
+    }
+    std::fprintf(stderr, "tick imbalance (busiest rank / mean): mean %.3f max %.3f\n",
+                 busy_ticks ? imbalance_sum / busy_ticks : 1.0, busy_ticks ? imbalance_max : 1.0);
+}
+
+// collective: gathers the events of every rank on rank 0, which writes the Chrome trace to path and prints the summary
+inline void write(const std::string &path, int ticks, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    const std::vector<Event> &mine = recorder.recorded();
+    int bytes = mine.size() * sizeof(Event);
+    std::vector<int> counts(size), displs(size, 0);
+    MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+    for (int r = 1; r < size; r++) displs[r] = displs[r - 1] + counts[r - 1];
+    std::vector<Event> all(rank == 0 ? (displs[size - 1] + counts[size - 1]) / sizeof(Event) : 0);
+    MPI_Gatherv(mine.data(), bytes, MPI_BYTE, all.data(), counts.data(), displs.data(), MPI_BYTE, 0, comm);
+    if (rank != 0) return;
+
+    std::vector<std::vector<Event>> per_rank(size);
+    for (int r = 0; r < size; r++) {
+        auto first = all.begin() + displs[r] / sizeof(Event);
+        per_rank[r].assign(first, first + counts[r] / sizeof(Event));
+    }
+
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) {
+        std::fprintf(stderr, "Failed to open %s\n", path.c_str());
+    } else {
+        std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (int r = 0; r < size; r++) {
+            std::fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+                         r ? ",\n" : "", r, r);
+        }
+        for (int r = 0; r < size; r++) {
+            for (const Event &e : per_rank[r]) {
+                std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"args\":{\"tick\":%d}}",
+                             PHASE_NAMES[e.phase], r, e.start * 1e6, (e.end - e.start) * 1e6, e.tick);
+            }
+        }
+        std::fprintf(f, "\n]}\n");
+        std::fclose(f);
+    }
+
+    print_summary(per_rank, ticks);
+}
+
+}  // namespace trace
+
+#ifdef TRAINS_NO_TRACE
+#define TRACE_SCOPE(phase) ((void)0)
+#define TRACE_TICK(tick) ((void)0)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(phase) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(phase)
+#define TRACE_TICK(tick) trace::recorder.set_tick(tick)
+#endif
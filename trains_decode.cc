@@ -0,0 +1,55 @@
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include "state.hpp"
+#include "packed_state.hpp"
+
+using std::string;
+using std::vector;
+
+// prints a --binary-output file as the text trains prints. The states are read, unpacked and formatted a few ticks at
+// a time, so memory stays at about one chunk of states
+constexpr size_t CHUNK_STATES = 1 << 20;
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << argv[0] << " <binary_output_file>\n";
+        return 1;
+    }
+
+    state_file::Reader reader(argv[1]);
+    if (!reader.ok()) {
+        std::cerr << "Failed to read " << argv[1] << '\n';
+        return 2;
+    }
+
+    // the places of every platform's link, built and sorted once for all the chunks
+    vector<uint64_t> links;
+    for (int i = 0; i < reader.stations.src.size(); i++) {
+        links.push_back((uint64_t)reader.stations.src[i] << 32 | (uint32_t)reader.stations.dest[i]);
+    }
+    state_format::Places places(std::move(links), reader.station_names);
+
+    std::ios_base::sync_with_stdio(0);
+    const vector<int> &counts = reader.counts;
+    for (int t = 0; t < counts.size();) {
+        // whole ticks, at least one
+        PackedTicks chunk;
+        chunk.begin = reader.begin + t;
+        size_t size = 0;
+        do {
+            chunk.counts.push_back(counts[t]);
+            size += counts[t++];
+        } while (t < counts.size() && size + counts[t] <= CHUNK_STATES);
+        if (!reader.read(size, chunk.states)) {
+            std::cerr << "Failed to read " << argv[1] << '\n';
+            return 2;
+        }
+
+        vector<State> states = chunk.unpack(reader.stations);
+        string out = format_states(states.data(), states.size(), chunk.begin, chunk.counts.size(), places);
+        std::cout.write(out.data(), out.size());
+    }
+    return 0;
+}
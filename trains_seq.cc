@@ -0,0 +1,119 @@
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <iostream>
+#include <chrono>
+
+#include "structs.hpp"
+#include "state.hpp"
+#include "lines.hpp"
+#include "input_parser.hpp"
+#include "topology.hpp"
+#include "network.hpp"
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// single process reference engine: the same Platform and PlatformLoadTimeGen code as trains, with no MPI, no event
+// bookkeeping and no threads. Every tick every platform is polled, and a train leaving a link goes straight into the
+// holding area of the next platform of its line, so the output can be diffed against trains (see diff_test.py)
+vector<State> simulate_seq(vector<Platform>& platforms, const vector<vector<int>>& terminal_platform_ids_for_each_line,
+                           vector<int> num_trains, int ticks, int num_ticks_to_print) {
+    int count_of_trains_spawned = 0;
+    for (int tick = 0; tick < ticks; tick++) {
+        // green, then yellow, then blue, and so on, left terminal then right terminal
+        for (int i = 0; i < num_trains.size(); i++) {
+            for (int pos = 0; pos <= 1; pos++) {
+                if (num_trains[i] == 0) continue;
+                int terminal = terminal_platform_ids_for_each_line[i][pos];
+                platforms[terminal].send_in({colors[i], count_of_trains_spawned}, tick);
+                count_of_trains_spawned++;
+                num_trains[i]--;
+            }
+        }
+
+        for (Platform& platform : platforms) {
+            Train train = platform.send_out(tick);
+            if (train == INVALID_TRAIN) continue;
+            int next = platform.output_platforms[train.line];
+            if (next >= 0) platforms[next].send_in(train, tick);
+        }
+
+        for (Platform& platform : platforms) platform.push_train_to_platform(tick);
+
+        if (tick >= ticks - num_ticks_to_print) {
+            for (Platform& platform : platforms) platform.save_all_states(tick);
+        }
+    }
+
+    vector<State> states;
+    for (Platform& platform : platforms) {
+        states.insert(states.end(), platform.saved_states.begin(), platform.saved_states.end());
+    }
+    return states;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << argv[0] << " <input_file>\n";
+        return 1;
+    }
+
+    MappedFile file(argv[1]);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << argv[1] << '\n';
+        return 2;
+    }
+    InputScanner in(file.begin(), file.end());
+
+    size_t S = in.number<size_t>();
+    size_t V = in.number<size_t>();
+    if (V > MAX_LINES) {
+        std::cerr << "At most " << MAX_LINES << " lines are supported, got " << V << '\n';
+        return 2;
+    }
+
+    vector<string> station_names;
+    for (size_t i = 0; i < S; i++) station_names.emplace_back(in.word());
+    vector<size_t> popularities;
+    for (size_t i = 0; i < S; i++) popularities.push_back(in.number<size_t>());
+
+    // the same input rules as load_input: the matrix starts on a line of its own, one row per line
+    if (!is_blank(in.line())) {
+        std::cerr << argv[1] << ": expected S, V, S names and S popularities, then the matrix on a new line\n";
+        return 2;
+    }
+    Topology topology(S);
+    const char *rest = parse_matrix_rows(in.position(), file.end(), 0, S,
+                                         [&](long long src, size_t dst, int travel_time) {
+                                             topology.add_link(src, dst, travel_time);
+                                         });
+    topology.finish();
+
+    in = InputScanner(rest, file.end());
+    unordered_map<char, vector<string>> station_lines;
+    for (size_t i = 0; i < V; i++) station_lines[colors[i]] = extract_station_names(in.line());
+
+    int ticks = in.number<int>();
+    vector<int> num_trains;
+    for (size_t i = 0; i < V; i++) num_trains.push_back(in.number<int>());
+    int num_ticks_to_print = in.number<int>();
+
+    auto start = std::chrono::steady_clock::now();
+
+    StationIndex station_index(station_names);
+    unordered_map<char, vector<int>> line_stations = line_station_ids(station_lines, station_index);
+    vector<Platform> platforms = make_platforms(topology, popularities);
+    for (const auto& [line, stations] : line_stations) link_platforms(line, stations, topology, platforms);
+    vector<vector<int>> terminal_platform_ids_for_each_line =
+        get_terminal_platform_ids_for_each_line(line_stations, topology);
+
+    vector<State> states = simulate_seq(platforms, terminal_platform_ids_for_each_line, num_trains, ticks,
+                                        num_ticks_to_print);
+    print_all_states_ptr(states.data(), states.size(), num_ticks_to_print, ticks, station_names);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << std::fixed << "seq_time:" << elapsed.count() << "s" << std::endl;
+    return 0;
+}